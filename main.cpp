@@ -2,6 +2,10 @@
 #include "ThisThread.h"
 #include "mbed.h"
 #include "ZSC31014.h"
+#include "NoiseAnalyzer.h"
+#include "CalibrationStore.h"
+#include "HealthMonitor.h"
+#include "ZLog.h"
 #include <cstdint>
 #include <cstdio>
 
@@ -15,6 +19,10 @@
 #define  GAIN      x192    //1.5 - 3 - 6 - 12 - 24 - 48 - 96 - 192
 #define New_address (0x33)
 
+#define NOISE_CHARACTERIZATION 0 // 1: stream raw samples at full rate and print a noise report
+#define NOISE_SAMPLES 8192
+#define NOISE_TARGET 2.0f        // counts
+
 using namespace metromotive;
 
 
@@ -24,6 +32,13 @@ char i2cAddress = 0x28;
 // char i2cAddress = 0x33;
 ZSC31014 DYMH(i2c, i2cAddress, enable); // The ZSC31014 IC, using the default address.
 Serial pc(USBTX, USBRX, 115200);  
+#if NOISE_CHARACTERIZATION
+NoiseAnalyzer noise(0.0005f); // period is measured during the run
+uint16_t trace[NOISE_SAMPLES]; // recorded first, analyzed and printed afterwards
+#endif
+CalibrationStore calibrationStore; // last two flash sectors
+CalibrationStore::Entry calibration;
+HealthMonitor health; // diagnostic status of every reading
 
 void calib() {
     printf("\n****\nSTART CALIB\n****\n");
@@ -105,50 +120,142 @@ void calib() {
     printf("Wrote basic configuration and started normal operation mode.\n");
 }
 
+#if NOISE_CHARACTERIZATION
+void characterize() {
+    printf("\n****\nNOISE CHARACTERIZATION\n****\n");
+
+    Timer timer;
+    noise.reset();
+    timer.start();
+
+    // One entry per fresh conversion: stale repeats would show up as
+    // correlated noise, and nothing else runs in the loop so the rate stays even.
+    // An unanswered read leaves 0x0000, which would pass as a valid 0 count.
+    for (int i = 0; i < NOISE_SAMPLES; ) {
+        uint16_t word;
+        if (DYMH.read_raw_word(word) && (word >> 14) != (uint8_t)ZSC31014::Status::stale) {
+            trace[i++] = word & 0x3FFF;
+        }
+    }
+
+    timer.stop();
+
+    // Raw samples are printed one per line so the trace can be recorded and
+    // re-analyzed offline with tools/noise_report.cpp.
+    for (int i = 0; i < NOISE_SAMPLES; i++) {
+        noise.addSample(trace[i]);
+        printf("%u\n", trace[i]);
+    }
+
+    noise.setSamplePeriod(timer.read() / NOISE_SAMPLES);
+    noise.printReport(NOISE_TARGET);
+}
+#endif
+
+bool restore() {
+    if (!calibrationStore.init()) {
+        return false;
+    }
+
+    DYMH.startCommandMode();
+
+    calibration.id = DYMH.getFactoryID();
+
+    if (!calibrationStore.load(calibration.id, calibration)) {
+        printf("No stored calibration for this sensor.\n");
+        calibration.gain = DYMH.getGain();
+        return false;
+    }
+
+    if (!calibrationStore.matches(DYMH, calibration)) {
+        printf("Sensor configuration changed since calibration.\n");
+        calibration.gain = DYMH.getGain();
+        return false;
+    }
+
+    DYMH.startNormalOperationMode();
+    calibrationStore.apply(DYMH, calibration);
+
+    printf("Restored calibration, bias %f\n", calibration.bias);
+    return true;
+}
+
 int main()
 {
-    calib();
-    printf("\nNew Address = 0x%3x \n",New_address);
-    // rtos::ThisThread::sleep_for(500ms);
-    wait(0.5);
+    bool restored = restore();
+
+    if (!restored) {
+        calib();
+        printf("\nNew Address = 0x%3x \n",New_address);
+        // rtos::ThisThread::sleep_for(500ms);
+        wait(0.5);
+    }
 
     enable = true;
+    DYMH.negotiateBusSpeed(); // up to the rated 400 kHz, falls back to 100 kHz if the wiring is too slow
+
+#if NOISE_CHARACTERIZATION
+    characterize();
+#endif
 
     uint16_t temp = 0;
     int sum_of_elems = 0;
-    int average = 0;
+    int average = (int)DYMH.get_bias();
     char reading[2] = {0, 0};
 
-    i2c.read(i2cAddress << 1, reading, 2);
-    // printf("\nNew Address = 0x%3x \n",New_address);
-    // rtos::ThisThread::sleep_for(500ms);
-    wait(0.5);
-    for (int i=0; i<20; i++) {
-        uint16_t tare[20] = {0};
+    if (!restored) {
         i2c.read(i2cAddress << 1, reading, 2);
-        tare[i] = reading[0] & 0b0111111;
-        tare[i] <<= 8;
-        tare[i] |= reading[1];
-        printf("Read %d  %d\n", i, tare[i]);
-        sum_of_elems += tare[i];
         // printf("\nNew Address = 0x%3x \n",New_address);
-        // rtos::ThisThread::sleep_for(100ms);
-        wait(0.1);
+        // rtos::ThisThread::sleep_for(500ms);
+        wait(0.5);
+        for (int i=0; i<20; i++) {
+            uint16_t tare[20] = {0};
+            i2c.read(i2cAddress << 1, reading, 2);
+            tare[i] = reading[0] & 0b0111111;
+            tare[i] <<= 8;
+            tare[i] |= reading[1];
+            ZLOG_INFO("Read %d  %d", i, tare[i]);
+            sum_of_elems += tare[i];
+            // printf("\nNew Address = 0x%3x \n",New_address);
+            // rtos::ThisThread::sleep_for(100ms);
+            wait(0.1);
+        }
+        average = sum_of_elems / 20;
+        ZLOG_INFO("Average %d", average);
+        zlog::flush();
+
+        DYMH.set_bias(average);
+        calibration.address = New_address; // as programmed by calib()
+        calibration.preAmpGain = ZSC31014::PreAmpGain::GAIN;
+        calibration.offset = (int16_t)0xE400;
+        calibrationStore.capture(DYMH, calibration);
+
+        if (!calibrationStore.save(calibration)) {
+            printf("Calibration not saved.\n");
+        }
     }
-    average = sum_of_elems / 20;
-    printf("Average %d\n\n-------\n\n",average);
+
+    DYMH.attachHealthMonitor(&health);
 
     while(1) {
-        reading[0] = 0;
-        reading[1] = 0;
-        i2c.read(i2cAddress << 1, reading, 2);
+        uint16_t word = 0;
+        bool answered = DYMH.read_raw_word(word);
+        uint8_t status = word >> 14;
+        temp = word & 0x3FFF;
         // printf("\nNew Address = 0x%3x \n",New_address);
      // rtos::ThisThread::sleep_for(20ms);
         wait(0.02);
-        temp = reading[0] & 0b0111111;
-        temp <<= 8;
-        temp |= reading[1];
-        printf("Read:  %d g\n", temp-average);
+        // isHealthy() still holds while degraded, so the word's own status decides too
+        if (!health.isHealthy()) {
+            ZLOG_WARN("Sensor fault 0x%02x, reading dropped", health.getFaults());
+        } else if (!answered || (status != (uint8_t)ZSC31014::Status::valid &&
+                                 status != (uint8_t)ZSC31014::Status::stale)) {
+            ZLOG_WARN("Status %d, reading dropped", answered ? status : -1);
+        } else {
+            ZLOG_INFO("Read:  %d g", temp-average);
+        }
+        DYMH.serviceHealth();
+        zlog::flush();
         // printf("\nNew Address = 0x%3x \n",New_address);
      // rtos::ThisThread::sleep_for(10ms);
         wait(0.1);
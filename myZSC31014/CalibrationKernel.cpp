@@ -0,0 +1,137 @@
+// Copyright 2023 prisma
+
+#include "CalibrationKernel.h"
+#include <string.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace metromotive {
+
+void calibrateBlockScalar(const uint16_t *words, int n, float gain, float offset,
+                          float *out, uint8_t *status) {
+    for (int i = 0; i < n; i++) {
+        out[i] = gain * (float)(words[i] & 0x3FFF) + offset;
+        status[i] = words[i] >> 14;
+    }
+}
+
+#if defined(__AVX2__)
+
+void calibrateBlock(const uint16_t *words, int n, float gain, float offset,
+                    float *out, uint8_t *status) {
+    const __m128i dataMask = _mm_set1_epi16(0x3FFF);
+    const __m256 vGain = _mm256_set1_ps(gain);
+    const __m256 vOffset = _mm256_set1_ps(offset);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i w = _mm_loadu_si128((const __m128i *)(words + i));
+
+        __m128i s = _mm_srli_epi16(w, 14);
+        _mm_storel_epi64((__m128i *)(status + i), _mm_packus_epi16(s, s));
+
+        __m256i d = _mm256_cvtepu16_epi32(_mm_and_si128(w, dataMask));
+        __m256 v = _mm256_cvtepi32_ps(d);
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_mul_ps(v, vGain), vOffset));
+    }
+
+    calibrateBlockScalar(words + i, n - i, gain, offset, out + i, status + i);
+}
+
+#elif defined(__SSE2__)
+
+void calibrateBlock(const uint16_t *words, int n, float gain, float offset,
+                    float *out, uint8_t *status) {
+    const __m128i dataMask = _mm_set1_epi16(0x3FFF);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 vGain = _mm_set1_ps(gain);
+    const __m128 vOffset = _mm_set1_ps(offset);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i w = _mm_loadu_si128((const __m128i *)(words + i));
+
+        __m128i s = _mm_srli_epi16(w, 14);
+        _mm_storel_epi64((__m128i *)(status + i), _mm_packus_epi16(s, s));
+
+        __m128i d = _mm_and_si128(w, dataMask);
+        __m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(d, zero));
+        __m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(d, zero));
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(lo, vGain), vOffset));
+        _mm_storeu_ps(out + i + 4, _mm_add_ps(_mm_mul_ps(hi, vGain), vOffset));
+    }
+
+    calibrateBlockScalar(words + i, n - i, gain, offset, out + i, status + i);
+}
+
+#elif defined(__ARM_NEON)
+
+void calibrateBlock(const uint16_t *words, int n, float gain, float offset,
+                    float *out, uint8_t *status) {
+    const uint16x8_t dataMask = vdupq_n_u16(0x3FFF);
+    const float32x4_t vOffset = vdupq_n_f32(offset);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        uint16x8_t w = vld1q_u16(words + i);
+
+        vst1_u8(status + i, vmovn_u16(vshrq_n_u16(w, 14)));
+
+        uint16x8_t d = vandq_u16(w, dataMask);
+        float32x4_t lo = vcvtq_f32_u32(vmovl_u16(vget_low_u16(d)));
+        float32x4_t hi = vcvtq_f32_u32(vmovl_u16(vget_high_u16(d)));
+        vst1q_f32(out + i, vmlaq_n_f32(vOffset, lo, gain));
+        vst1q_f32(out + i + 4, vmlaq_n_f32(vOffset, hi, gain));
+    }
+
+    calibrateBlockScalar(words + i, n - i, gain, offset, out + i, status + i);
+}
+
+#else
+
+void calibrateBlock(const uint16_t *words, int n, float gain, float offset,
+                    float *out, uint8_t *status) {
+    int i = 0;
+
+    // Two samples per 32-bit word, four samples per iteration
+    for (; i + 4 <= n; i += 4) {
+        uint32_t w[2];
+        memcpy(w, words + i, sizeof(w));
+
+        uint32_t s0 = (w[0] >> 14) & 0x00030003;
+        uint32_t s1 = (w[1] >> 14) & 0x00030003;
+        uint32_t d0 = w[0] & 0x3FFF3FFF;
+        uint32_t d1 = w[1] & 0x3FFF3FFF;
+
+        // Lane order within a word follows memory order
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        status[i + 0] = s0 >> 16;
+        status[i + 1] = s0;
+        status[i + 2] = s1 >> 16;
+        status[i + 3] = s1;
+        out[i + 0] = gain * (float)(d0 >> 16) + offset;
+        out[i + 1] = gain * (float)(d0 & 0xFFFF) + offset;
+        out[i + 2] = gain * (float)(d1 >> 16) + offset;
+        out[i + 3] = gain * (float)(d1 & 0xFFFF) + offset;
+#else
+        status[i + 0] = s0;
+        status[i + 1] = s0 >> 16;
+        status[i + 2] = s1;
+        status[i + 3] = s1 >> 16;
+        out[i + 0] = gain * (float)(d0 & 0xFFFF) + offset;
+        out[i + 1] = gain * (float)(d0 >> 16) + offset;
+        out[i + 2] = gain * (float)(d1 & 0xFFFF) + offset;
+        out[i + 3] = gain * (float)(d1 >> 16) + offset;
+#endif
+    }
+
+    calibrateBlockScalar(words + i, n - i, gain, offset, out + i, status + i);
+}
+
+#endif
+
+} // namespace metromotive
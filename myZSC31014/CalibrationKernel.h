@@ -0,0 +1,28 @@
+// Copyright 2023 prisma
+
+#ifndef CALIBRATIONKERNEL_H
+#define CALIBRATIONKERNEL_H
+
+#include <stdint.h>
+
+namespace metromotive {
+
+// Block conversion of raw ZSC31014 output words to calibrated values.
+//
+// Each input word is the 16-bit value as read from the bus: bits 15:14 hold the
+// status (see ZSC31014::Status) and bits 13:0 the bridge reading.
+// out[i] = gain * (words[i] & 0x3FFF) + offset, status[i] = words[i] >> 14.
+//
+// Uses AVX2, SSE2 or NEON when the compiler targets them. On Cortex-M4/M7 the
+// FPU is scalar, so the loop instead masks and splits two samples per 32-bit
+// word (SIMD within a register) and is unrolled by four, CMSIS-DSP style.
+void calibrateBlock(const uint16_t *words, int n, float gain, float offset,
+                    float *out, uint8_t *status);
+
+// One sample per iteration; reference for calibrateBlock and used for block tails.
+void calibrateBlockScalar(const uint16_t *words, int n, float gain, float offset,
+                          float *out, uint8_t *status);
+
+} // namespace metromotive
+
+#endif //CALIBRATIONKERNEL_H
@@ -0,0 +1,365 @@
+// Copyright 2023 prisma
+
+#include "CalibrationStore.h"
+#include "MbedCRC.h"
+#include <stddef.h>
+#include <string.h>
+
+namespace metromotive {
+
+static const uint32_t maxSlotSize = 256;
+
+CalibrationStore::CalibrationStore(uint32_t address, uint32_t size) :
+    _address(address),
+    _size(size),
+    _ready(false),
+    _active(0),
+    _nextSlot(0),
+    _sequence(0)
+{
+}
+
+bool CalibrationStore::init() {
+    if (_flash.init() != 0) {
+        printf("Unable to initialize flash for calibration store.\n");
+        return false;
+    }
+
+    if (_address == 0) {
+        uint32_t end = _flash.get_flash_start() + _flash.get_flash_size();
+
+        _sectorSize[1] = _flash.get_sector_size(end - 1);
+        _sectorAddress[1] = end - _sectorSize[1];
+        _sectorSize[0] = _flash.get_sector_size(_sectorAddress[1] - 1);
+        _sectorAddress[0] = _sectorAddress[1] - _sectorSize[0];
+    } else {
+        _sectorAddress[0] = _address;
+        _sectorSize[0] = _flash.get_sector_size(_address);
+        _sectorAddress[1] = _address + _sectorSize[0];
+        _sectorSize[1] = _flash.get_sector_size(_sectorAddress[1]);
+
+        if (_sectorSize[0] + _sectorSize[1] > _size) {
+            printf("Calibration store region must span two whole flash sectors.\n");
+            return false;
+        }
+    }
+
+#if defined(FLASHIAP_APP_ROM_END_ADDR)
+    if (_sectorAddress[0] < FLASHIAP_APP_ROM_END_ADDR) {
+        printf("Calibration store region overlaps the application image.\n");
+        return false;
+    }
+#endif
+
+    uint32_t page = _flash.get_page_size();
+    uint32_t slot = (CALIBRATION_STORE_SLOT > sizeof(Record)) ? CALIBRATION_STORE_SLOT : sizeof(Record);
+    _slotSize = ((slot + page - 1) / page) * page;
+
+    if (_slotSize > maxSlotSize) {
+        printf("Flash page size %lu too large for calibration store.\n", (unsigned long)page);
+        return false;
+    }
+
+    this->scan();
+    _ready = true;
+
+    return true;
+}
+
+void CalibrationStore::scan() {
+    struct Record record;
+    uint32_t latest = 0;
+
+    _sequence = 0;
+    _active = -1;
+
+    for (int s = 0; s < 2; s++) {
+        _sealed[s] = this->isSealed(s);
+
+        for (uint32_t offset = 0; offset + _slotSize <= _sectorSize[s]; offset += _slotSize) {
+            uint32_t address = _sectorAddress[s] + offset;
+
+            if (this->isErased(address)) {
+                if (offset == 0) {
+                    continue; // unfinished compaction: slot 0 still waits for the seal
+                }
+                break;
+            }
+
+            // Torn writes (power loss) are skipped, not treated as the log end
+            if (!this->readRecord(address, record) && !this->readRecord(address, record, sealMagic)) {
+                continue;
+            }
+
+            // Sequence numbers from every sector, so new records outrank copies
+            // left in an unsealed one
+            if (record.sequence > _sequence) {
+                _sequence = record.sequence;
+            }
+
+            if (_sealed[s] && record.sequence > latest) {
+                latest = record.sequence;
+                _active = s;
+            }
+        }
+    }
+
+    if (_active < 0) {
+        _active = 0; // nothing stored yet; save() seals the sector first
+    }
+
+    _nextSlot = _sectorSize[_active];
+    for (uint32_t offset = 0; offset + _slotSize <= _sectorSize[_active]; offset += _slotSize) {
+        if (this->isErased(_sectorAddress[_active] + offset)) {
+            _nextSlot = offset;
+            break;
+        }
+    }
+}
+
+bool CalibrationStore::load(const struct ZSC31014::FactoryID &id, struct Entry &entry) {
+    struct Record record;
+    struct Record latest;
+    bool found = false;
+
+    if (!_ready) {
+        return false;
+    }
+
+    for (int s = 0; s < 2; s++) {
+        if (!_sealed[s]) {
+            continue;
+        }
+
+        for (uint32_t offset = 0; offset + _slotSize <= _sectorSize[s]; offset += _slotSize) {
+            uint32_t address = _sectorAddress[s] + offset;
+
+            if (this->isErased(address)) {
+                break;
+            }
+
+            if (!this->readRecord(address, record) ||
+                !sameDevice(record, id.lotNumber, id.waferNumber, id.waferXCoordinate, id.waferYCoordinate)) {
+                continue;
+            }
+
+            if (!found || record.sequence > latest.sequence) {
+                latest = record;
+                found = true;
+            }
+        }
+    }
+
+    if (!found) {
+        return false;
+    }
+
+    entry.id = id;
+    entry.address = latest.address;
+    entry.preAmpGain = (ZSC31014::PreAmpGain)latest.preAmpGain;
+    entry.offset = latest.offset;
+    entry.gain = latest.gain;
+    entry.calibpoly[0] = latest.calibpoly[0];
+    entry.calibpoly[1] = latest.calibpoly[1];
+    entry.bias = latest.bias;
+
+    return true;
+}
+
+bool CalibrationStore::save(const struct Entry &entry) {
+    struct Record record;
+
+    if (!_ready) {
+        return false;
+    }
+
+    if (!_sealed[_active]) {
+        // Nothing stored yet, or only the leftovers of a compaction cut short
+        if (_flash.erase(_sectorAddress[_active], _sectorSize[_active]) != 0) {
+            printf("Unable to erase calibration store sector.\n");
+            return false;
+        }
+
+        if (!this->startSector(_active, _slotSize)) {
+            return false;
+        }
+    }
+
+    if (_nextSlot + _slotSize > _sectorSize[_active] && !this->compact()) {
+        return false;
+    }
+
+    memset(&record, 0, sizeof(record));
+    record.sequence = _sequence + 1;
+    record.lotNumber = entry.id.lotNumber;
+    record.waferNumber = entry.id.waferNumber;
+    record.waferXCoordinate = entry.id.waferXCoordinate;
+    record.waferYCoordinate = entry.id.waferYCoordinate;
+    record.address = entry.address;
+    record.preAmpGain = (uint8_t)entry.preAmpGain;
+    record.offset = entry.offset;
+    record.gain = entry.gain;
+    record.calibpoly[0] = entry.calibpoly[0];
+    record.calibpoly[1] = entry.calibpoly[1];
+    record.bias = entry.bias;
+
+    if (!this->writeRecord(_sectorAddress[_active] + _nextSlot, record)) {
+        return false;
+    }
+
+    _sequence = record.sequence;
+    _nextSlot += _slotSize;
+
+    return true;
+}
+
+bool CalibrationStore::compact() {
+    struct Record record;
+    struct Record later;
+    int other = 1 - _active;
+    uint32_t destination = _slotSize; // slot 0 is for the seal
+
+    _sealed[other] = false;
+    if (_flash.erase(_sectorAddress[other], _sectorSize[other]) != 0) {
+        printf("Unable to erase calibration store sector.\n");
+        return false;
+    }
+
+    for (uint32_t offset = 0; offset + _slotSize <= _sectorSize[_active]; offset += _slotSize) {
+        if (!this->readRecord(_sectorAddress[_active] + offset, record)) {
+            continue;
+        }
+
+        // Sequence numbers grow along the log, so any later record of the same device supersedes this one
+        bool superseded = false;
+        for (uint32_t next = offset + _slotSize; next + _slotSize <= _sectorSize[_active]; next += _slotSize) {
+            if (this->readRecord(_sectorAddress[_active] + next, later) &&
+                sameDevice(later, record.lotNumber, record.waferNumber,
+                           record.waferXCoordinate, record.waferYCoordinate)) {
+                superseded = true;
+                break;
+            }
+        }
+
+        if (superseded) {
+            continue;
+        }
+
+        if (destination + _slotSize > _sectorSize[other]) {
+            printf("Calibration store full.\n");
+            return false;
+        }
+
+        // Re-stamped so the new sector holds the highest sequence even if we lose power here
+        record.sequence = ++_sequence;
+        if (!this->writeRecord(_sectorAddress[other] + destination, record)) {
+            return false;
+        }
+        destination += _slotSize;
+    }
+
+    // Only a sealed sector can become active: if power fails before this
+    // point, scan() keeps the old sector and the next compaction starts over
+    return this->startSector(other, destination);
+}
+
+bool CalibrationStore::startSector(int sector, uint32_t nextSlot) {
+    struct Record seal;
+
+    memset(&seal, 0, sizeof(seal));
+    seal.sequence = ++_sequence;
+
+    if (!this->writeRecord(_sectorAddress[sector], seal, sealMagic)) {
+        return false;
+    }
+
+    _sealed[sector] = true;
+    _active = sector;
+    _nextSlot = nextSlot;
+
+    return true;
+}
+
+bool CalibrationStore::isSealed(int sector) {
+    struct Record record;
+
+    return this->readRecord(_sectorAddress[sector], record, sealMagic);
+}
+
+bool CalibrationStore::readRecord(uint32_t address, struct Record &record, uint32_t magic) {
+    if (_flash.read(&record, address, sizeof(record)) != 0) {
+        return false;
+    }
+
+    return record.magic == magic &&
+           record.version == CALIBRATION_STORE_VERSION &&
+           record.length == sizeof(record) &&
+           record.crc == this->computeCRC(record);
+}
+
+bool CalibrationStore::isErased(uint32_t address) {
+    uint8_t magic[4];
+    uint8_t erased = _flash.get_erase_value();
+
+    if (_flash.read(magic, address, sizeof(magic)) != 0) {
+        return false;
+    }
+
+    return magic[0] == erased && magic[1] == erased && magic[2] == erased && magic[3] == erased;
+}
+
+bool CalibrationStore::writeRecord(uint32_t address, struct Record &record, uint32_t magic) {
+    static uint8_t buffer[maxSlotSize];
+    struct Record check;
+
+    record.magic = magic;
+    record.version = CALIBRATION_STORE_VERSION;
+    record.length = sizeof(record);
+    record.crc = this->computeCRC(record);
+
+    memset(buffer, _flash.get_erase_value(), _slotSize);
+    memcpy(buffer, &record, sizeof(record));
+
+    if (_flash.program(buffer, address, _slotSize) != 0 || !this->readRecord(address, check, magic)) {
+        printf("Unable to write calibration record to flash.\n");
+        return false;
+    }
+
+    return true;
+}
+
+uint32_t CalibrationStore::computeCRC(const struct Record &record) {
+    MbedCRC<POLY_32BIT_ANSI, 32> ct;
+    uint32_t crc = 0;
+
+    ct.compute((void *)&record, offsetof(Record, crc), &crc);
+
+    return crc;
+}
+
+bool CalibrationStore::sameDevice(const struct Record &record, int32_t lot, int32_t wafer, int32_t x, int32_t y) {
+    return record.lotNumber == lot &&
+           record.waferNumber == wafer &&
+           record.waferXCoordinate == x &&
+           record.waferYCoordinate == y;
+}
+
+void CalibrationStore::capture(ZSC31014 &sensor, struct Entry &entry) {
+    sensor.get_linear_calib(entry.calibpoly[0], entry.calibpoly[1]);
+    entry.bias = sensor.get_bias();
+}
+
+void CalibrationStore::apply(ZSC31014 &sensor, const struct Entry &entry) {
+    sensor.set_linear_calib(entry.calibpoly[0], entry.calibpoly[1]);
+    sensor.set_bias(entry.bias);
+}
+
+bool CalibrationStore::matches(ZSC31014 &sensor, const struct Entry &entry) {
+    // The calibration polynomial only holds for the front end it was measured with
+    return sensor.getZMDIConfig2().slaveAddress == entry.address &&
+           sensor.getBridgeConfig().preAmpGain == entry.preAmpGain &&
+           sensor.getOffset() == entry.offset &&
+           sensor.getGain() == entry.gain;
+}
+
+} // namespace metromotive
@@ -0,0 +1,108 @@
+// Copyright 2023 prisma
+
+#ifndef CALIBRATIONSTORE_H
+#define CALIBRATIONSTORE_H
+
+#include "mbed.h"
+#include "FlashIAP.h"
+#include "ZSC31014.h"
+#include <stdint.h>
+
+// Bump when the record layout changes; older records are then ignored
+#define CALIBRATION_STORE_VERSION 1
+
+// Bytes per record slot in flash, rounded up to the flash program page size
+#ifndef CALIBRATION_STORE_SLOT
+#define CALIBRATION_STORE_SLOT 64
+#endif
+
+namespace metromotive {
+
+// Per-device calibration and tare state kept in MCU flash, keyed by the
+// ZSC31014 factory ID so a swapped sensor is detected and not restored.
+//
+// Records are appended to a log spanning two flash sectors. When the active
+// sector is full the latest record of each device is copied to the other one,
+// so every slot is written once per erase and erases alternate between the
+// two sectors. A record only counts if its magic, version and CRC match.
+// Slot 0 of a sector holds a seal, written once the copy is complete; only a
+// sealed sector is read or becomes active, so a compaction cut short by a
+// power loss never replaces the sector it was copying from.
+class CalibrationStore {
+public:
+    // Defaults to the last two sectors of the internal flash. init() fails if
+    // the region overlaps the application image (FLASHIAP_APP_ROM_END_ADDR).
+    CalibrationStore(uint32_t address = 0, uint32_t size = 0);
+
+    struct Entry {
+        struct ZSC31014::FactoryID id;
+        char address; // 7-bit I2C address
+        ZSC31014::PreAmpGain preAmpGain;
+        int16_t offset; // bridge offset register
+        float gain;     // bridge gain register
+        float calibpoly[2];
+        float bias;
+    };
+
+    bool init();
+
+    bool load(const struct ZSC31014::FactoryID &id, struct Entry &entry);
+    bool save(const struct Entry &entry);
+
+    // Copy the RAM calibration state between driver and entry
+    void capture(ZSC31014 &sensor, struct Entry &entry);
+    void apply(ZSC31014 &sensor, const struct Entry &entry);
+
+    // In command mode: true if the chip's EEPROM still holds the address,
+    // gain and offset choices the entry was calibrated with
+    bool matches(ZSC31014 &sensor, const struct Entry &entry);
+
+private:
+    struct Record {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t length;
+        uint32_t sequence;
+        int32_t lotNumber;
+        int32_t waferNumber;
+        int32_t waferXCoordinate;
+        int32_t waferYCoordinate;
+        uint8_t address;
+        uint8_t preAmpGain;
+        int16_t offset;
+        float gain;
+        float calibpoly[2];
+        float bias;
+        uint32_t crc; // over all fields above
+    };
+
+    static const uint32_t recordMagic = 0x43435A53; // "SZCC"
+    static const uint32_t sealMagic = 0x4C45535A;   // "ZSEL", slot 0 of a complete sector
+
+    FlashIAP _flash;
+    uint32_t _address;
+    uint32_t _size;
+    uint32_t _sectorAddress[2];
+    uint32_t _sectorSize[2];
+    uint32_t _slotSize;
+
+    bool _ready;
+    bool _sealed[2];
+    int _active;
+    uint32_t _nextSlot; // offset in the active sector, _sectorSize when full
+    uint32_t _sequence; // highest sequence found
+
+    void scan();
+    bool readRecord(uint32_t address, struct Record &record, uint32_t magic = recordMagic);
+    bool isErased(uint32_t address);
+    bool writeRecord(uint32_t address, struct Record &record, uint32_t magic = recordMagic);
+    bool compact();
+    bool startSector(int sector, uint32_t nextSlot); // seal it and make it active
+    bool isSealed(int sector);
+    uint32_t computeCRC(const struct Record &record);
+    static bool sameDevice(const struct Record &record, int32_t lot, int32_t wafer, int32_t x, int32_t y);
+};
+
+} // namespace metromotive
+
+#endif //CALIBRATIONSTORE_H
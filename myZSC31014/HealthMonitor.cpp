@@ -0,0 +1,194 @@
+// Copyright 2023 prisma
+
+#include "HealthMonitor.h"
+#include "ZLog.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace metromotive {
+
+HealthMonitor::HealthMonitor(uint16_t minRaw, uint16_t maxRaw, int stuckSamples) :
+    _minRaw(minRaw),
+    _maxRaw(maxRaw),
+    _stuckSamples(stuckSamples)
+{
+    this->reset();
+}
+
+void HealthMonitor::setRange(uint16_t minRaw, uint16_t maxRaw) {
+    _minRaw = minRaw;
+    _maxRaw = maxRaw;
+}
+
+void HealthMonitor::update(uint16_t word) {
+    uint16_t data = word & 0x3FFF;
+    uint8_t faults = 0;
+
+    _stats.samples++;
+
+    switch (word >> 14) {
+        case 0b00: // valid
+            if (data < _minRaw || data > _maxRaw) {
+                faults |= outOfRange;
+                _stats.outOfRange++;
+            }
+
+            if (_haveData && data == _lastData) {
+                _sameCount++;
+            } else {
+                _sameCount = 0;
+            }
+            _lastData = data;
+            _haveData = true;
+
+            if (_sameCount + 1 >= _stuckSamples) {
+                faults |= stuck;
+                if (_sameCount + 1 == _stuckSamples) {
+                    _stats.stuckEvents++;
+                }
+            }
+            break;
+
+        case 0b01:
+            faults |= commandMode;
+            break;
+
+        case 0b10: // stale: no new conversion since the last read, nothing to judge
+            _stats.stale++;
+            return;
+
+        case 0b11:
+            faults |= diagnostic;
+            _stats.diagnostics++;
+            _stats.lastDiagnostic = word;
+            break;
+    }
+
+    this->addSample(faults);
+}
+
+void HealthMonitor::updateBusError() {
+    _stats.samples++;
+    _stats.busErrors++;
+
+    this->addSample(busError);
+}
+
+bool HealthMonitor::feed(uint16_t word, bool ok) {
+    if (ok) {
+        this->update(word);
+    } else {
+        this->updateBusError();
+    }
+
+    return this->isRecoveryDue();
+}
+
+void HealthMonitor::addSample(uint8_t faults) {
+    _window = (_window << 1) | (faults != 0 ? 1 : 0);
+    _windowFaults[_windowIndex] = faults;
+    _windowIndex = (_windowIndex + 1) % HEALTH_WINDOW;
+
+    _faults = 0;
+    for (int i = 0; i < HEALTH_WINDOW; i++) {
+        _faults |= _windowFaults[i];
+    }
+
+    if (faults != 0) {
+        _cleanSamples = 0;
+    } else if (++_cleanSamples >= HEALTH_WINDOW) {
+        _attempts = 0; // a full clean window: the last recovery worked
+    }
+
+    if (_state == State::failed && _cleanSamples >= HEALTH_WINDOW) {
+        this->setState(State::ok); // came back by itself, e.g. a loose connector
+        return;
+    }
+
+    if (_state == State::failed || _state == State::fault) {
+        return; // left by recoveryStarted() / reset()
+    }
+
+    int errors = __builtin_popcount(_window);
+
+    if (errors >= HEALTH_FAULT_ERRORS) {
+        this->setState(_attempts >= HEALTH_RECOVERY_LIMIT ? State::failed : State::fault);
+    } else if (_state == State::recovering && faults != 0) {
+        return; // keep waiting for the first valid conversion
+    } else if (errors >= HEALTH_DEGRADED_ERRORS) {
+        this->setState(State::degraded);
+    } else {
+        this->setState(State::ok);
+    }
+}
+
+void HealthMonitor::setState(State state) {
+    if (state == _state) {
+        return;
+    }
+
+    _state = state;
+
+    if (state == State::ok) {
+        ZLOG_INFO("Sensor healthy");
+    } else {
+        ZLOG_WARN("Sensor health state %d, faults 0x%02x, errors %d/%d",
+                  (int)state, _faults, __builtin_popcount(_window), HEALTH_WINDOW);
+    }
+}
+
+float HealthMonitor::getErrorRate() {
+    return (float)__builtin_popcount(_window) / HEALTH_WINDOW;
+}
+
+bool HealthMonitor::isRecoveryDue() {
+    return _state == State::fault;
+}
+
+void HealthMonitor::recoveryStarted() {
+    _attempts++;
+    _stats.recoveries++;
+
+    // Judge the restarted sensor on its own samples only
+    _window = 0;
+    memset(_windowFaults, 0, sizeof(_windowFaults));
+    _faults = 0;
+    _haveData = false;
+    _sameCount = 0;
+    _cleanSamples = 0;
+
+    this->setState(State::recovering);
+}
+
+void HealthMonitor::reset() {
+    _state = State::ok;
+    _faults = 0;
+    _window = 0;
+    memset(_windowFaults, 0, sizeof(_windowFaults));
+    _windowIndex = 0;
+    _lastData = 0;
+    _sameCount = 0;
+    _haveData = false;
+    _attempts = 0;
+    _cleanSamples = 0;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+struct HealthMonitor::Stats HealthMonitor::getStats() {
+    return _stats;
+}
+
+void HealthMonitor::printReport() {
+    static const char *names[] = { "ok", "degraded", "fault", "recovering", "failed" };
+
+    printf("Sensor health: %s, error rate %.0f%%, faults 0x%02x\n",
+           names[(int)_state], this->getErrorRate() * 100.0f, _faults);
+    printf("  %lu samples, %lu stale, %lu diagnostic (last 0x%04x), %lu bus errors, "
+           "%lu out of range, %lu stuck, %lu recoveries\n",
+           (unsigned long)_stats.samples, (unsigned long)_stats.stale,
+           (unsigned long)_stats.diagnostics, _stats.lastDiagnostic,
+           (unsigned long)_stats.busErrors, (unsigned long)_stats.outOfRange,
+           (unsigned long)_stats.stuckEvents, (unsigned long)_stats.recoveries);
+}
+
+} // namespace metromotive
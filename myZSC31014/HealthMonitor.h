@@ -0,0 +1,122 @@
+// Copyright 2023 prisma
+
+#ifndef HEALTHMONITOR_H
+#define HEALTHMONITOR_H
+
+#include <stdint.h>
+
+// Recent samples looked at for the error rate (one bit each)
+#define HEALTH_WINDOW 32
+
+// Errors in the window before the sensor is reported degraded / faulty
+#ifndef HEALTH_DEGRADED_ERRORS
+#define HEALTH_DEGRADED_ERRORS 1
+#endif
+
+#ifndef HEALTH_FAULT_ERRORS
+#define HEALTH_FAULT_ERRORS 8
+#endif
+
+// Identical fresh conversions in a row before the output counts as stuck.
+// A live bridge always shows a few counts of noise at the gains used here.
+#ifndef HEALTH_STUCK_SAMPLES
+#define HEALTH_STUCK_SAMPLES 200
+#endif
+
+// Power cycles tried before giving up on the sensor
+#ifndef HEALTH_RECOVERY_LIMIT
+#define HEALTH_RECOVERY_LIMIT 3
+#endif
+
+namespace metromotive {
+
+// Watches the words the driver already reads in normal operation. With
+// enableSensorConnectionCheck / enableSensorShortCheck set in ZMDI_Config2 a
+// broken or shorted bridge is reported in the status bits (11, diagnostic);
+// together with bus errors, data at the rails and a frozen output these feed
+// an error rate over the last HEALTH_WINDOW samples.
+//
+// The state is a plain variable updated as samples arrive, so getState() and
+// isHealthy() cost nothing on the bus. When the sensor turns faulty,
+// ZSC31014::serviceHealth() power cycles it, at most HEALTH_RECOVERY_LIMIT
+// times in a row.
+class HealthMonitor {
+public:
+    enum class State : uint8_t {
+        ok,
+        degraded,   // occasional errors, readings still usable
+        fault,      // recovery due
+        recovering, // power cycled, waiting for valid data
+        failed      // recovery limit reached
+    };
+
+    // Bits of getFaults(), seen in the current window
+    enum Fault : uint8_t {
+        diagnostic = 1 << 0,  // status 11: bridge open or shorted
+        busError = 1 << 1,    // no acknowledge
+        outOfRange = 1 << 2,  // data outside [minRaw, maxRaw]
+        stuck = 1 << 3,       // no change for stuckSamples conversions
+        commandMode = 1 << 4  // status 01 in the normal sample stream
+    };
+
+    struct Stats {
+        uint32_t samples;
+        uint32_t stale;
+        uint32_t diagnostics;
+        uint32_t busErrors;
+        uint32_t outOfRange;
+        uint32_t stuckEvents;
+        uint32_t recoveries;
+        uint16_t lastDiagnostic; // last status 11 word, for the log
+    };
+
+    // Rails excluded by default: an open input drives the output to them
+    HealthMonitor(uint16_t minRaw = 0x0001, uint16_t maxRaw = 0x3FFE,
+                  int stuckSamples = HEALTH_STUCK_SAMPLES);
+
+    void setRange(uint16_t minRaw, uint16_t maxRaw);
+
+    // Called by the driver for every word read in normal operation
+    void update(uint16_t word);
+    void updateBusError();
+    bool feed(uint16_t word, bool ok); // either of the above, then isRecoveryDue()
+
+    State getState() { return _state; }
+    bool isHealthy() { return _state == State::ok || _state == State::degraded; }
+    uint8_t getFaults() { return _faults; }
+    float getErrorRate(); // errors over the window, 0..1
+
+    // Driver side of the recovery
+    bool isRecoveryDue();
+    void recoveryStarted();
+
+    void reset(); // also re-arms recovery after failed
+    struct Stats getStats();
+    void printReport();
+
+private:
+    uint16_t _minRaw;
+    uint16_t _maxRaw;
+    int _stuckSamples;
+
+    volatile State _state;
+    uint8_t _faults;
+    uint32_t _window; // bit set per sample with an error, newest in bit 0
+    uint8_t _windowFaults[HEALTH_WINDOW]; // fault bits of the samples in _window
+    int _windowIndex;
+
+    uint16_t _lastData;
+    int _sameCount;
+    bool _haveData;
+    int _attempts;
+    int _cleanSamples;
+
+    struct Stats _stats;
+
+    void addSample(uint8_t faults);
+    void setState(State state);
+};
+
+} // namespace metromotive
+
+#endif //HEALTHMONITOR_H
@@ -0,0 +1,366 @@
+// Copyright 2023 prisma
+
+#include "I2CBus.h"
+#include "ZLog.h"
+
+namespace metromotive {
+
+I2CBus::I2CBus(I2C &i2c, int frequency) :
+    _i2c(i2c),
+    _frequency(frequency),
+    _clientCount(0),
+    _queued(0),
+    _sequence(0),
+    _running(false)
+{
+    _i2c.frequency(frequency);
+    this->resetStats();
+}
+
+int I2CBus::addClient(const char *name, Priority priority) {
+    if (_clientCount >= I2CBUS_MAX_CLIENTS) {
+        ZLOG_ERROR("Too many I2C bus clients.");
+        return -1;
+    }
+
+    struct Client &client = _clients[_clientCount];
+
+    client.stats.name = name;
+    client.stats.priority = priority;
+    client.stats.transactions = 0;
+    client.stats.errors = 0;
+    client.stats.deadlineMisses = 0;
+    client.stats.busyUs = 0;
+    client.stats.maxWaitUs = 0;
+    client.periodUs = 0;
+    client.slotUs = 0;
+    client.nextSlot = 0;
+
+    return _clientCount++;
+}
+
+void I2CBus::reserve(int client, uint32_t periodUs, uint32_t durationUs) {
+    _clients[client].slotUs = durationUs;
+    _clients[client].nextSlot = us_ticker_read() + periodUs;
+    _clients[client].periodUs = periodUs;
+}
+
+bool I2CBus::submit(int client, struct Transaction &transaction) {
+    if (!this->fitsBetweenSlots(client, transaction)) {
+        ZLOG_ERROR("I2C transfer longer than the gap between reserved slots.");
+        return false;
+    }
+
+    transaction.client = client;
+    transaction.done = false;
+    transaction.result = -1;
+    transaction.queuedAt = us_ticker_read();
+
+    core_util_critical_section_enter();
+
+    if (_queued >= I2CBUS_QUEUE_LENGTH) {
+        core_util_critical_section_exit();
+        ZLOG_ERROR("I2C bus queue full.");
+        return false;
+    }
+
+    transaction.sequence = _sequence++;
+    _queue[_queued++] = &transaction;
+
+    core_util_critical_section_exit();
+
+    return true;
+}
+
+void I2CBus::dispatch() {
+    if (core_util_is_isr_active()) {
+        // Transfers block; the thread-context dispatcher runs what was submitted here
+        return;
+    }
+
+    core_util_critical_section_enter();
+    if (_running) {
+        // The running dispatcher picks the new transaction up when the current one ends
+        core_util_critical_section_exit();
+        return;
+    }
+    _running = true;
+#if MBED_CONF_RTOS_PRESENT
+    _dispatcher = osThreadGetId();
+#endif
+    core_util_critical_section_exit();
+
+    while (true) {
+        bool blocked = false;
+
+        core_util_critical_section_enter();
+        struct Transaction *transaction = this->takeNext(blocked);
+        if (transaction == NULL && !blocked) {
+            _running = false;
+            core_util_critical_section_exit();
+            return;
+        }
+        core_util_critical_section_exit();
+
+        if (transaction == NULL) {
+            // Only work that would overlap a reserved slot is left: let the slot pass
+            wait_us(10);
+            continue;
+        }
+
+        this->execute(*transaction);
+    }
+}
+
+bool I2CBus::insideDispatch() {
+    if (!_running) {
+        return false;
+    }
+
+#if MBED_CONF_RTOS_PRESENT
+    return _dispatcher == osThreadGetId();
+#else
+    return true; // bare metal: the only dispatcher is the one we are called from
+#endif
+}
+
+int I2CBus::pending() {
+    return _queued;
+}
+
+struct I2CBus::Transaction *I2CBus::takeNext(bool &blocked) {
+    uint32_t now = us_ticker_read();
+    int best = -1;
+
+    for (int i = 0; i < _queued; i++) {
+        if (this->collidesWithSlot(*_queue[i], now)) {
+            blocked = true;
+            continue;
+        }
+
+        if (best < 0 || this->isBefore(*_queue[i], *_queue[best])) {
+            best = i;
+        }
+    }
+
+    if (best < 0) {
+        return NULL;
+    }
+
+    struct Transaction *result = _queue[best];
+    _queue[best] = _queue[--_queued];
+
+    return result;
+}
+
+bool I2CBus::isBefore(const struct Transaction &a, const struct Transaction &b) {
+    Priority pa = _clients[a.client].stats.priority;
+    Priority pb = _clients[b.client].stats.priority;
+
+    if (pa != pb) {
+        return pa < pb;
+    }
+
+    if (a.deadline != 0 && b.deadline != 0 && a.deadline != b.deadline) {
+        return (int32_t)(a.deadline - b.deadline) < 0;
+    } else if ((a.deadline != 0) != (b.deadline != 0)) {
+        return a.deadline != 0;
+    }
+
+    return (int32_t)(a.sequence - b.sequence) < 0;
+}
+
+bool I2CBus::collidesWithSlot(const struct Transaction &transaction, uint32_t now) {
+    Priority priority = _clients[transaction.client].stats.priority;
+    uint32_t duration = this->estimateUs(transaction.writeLength, transaction.readLength);
+
+    for (int i = 0; i < _clientCount; i++) {
+        struct Client &client = _clients[i];
+
+        if (client.periodUs == 0 || client.stats.priority >= priority) {
+            continue;
+        }
+
+        // Slot passed without the client using it: move on to the next one
+        while ((int32_t)(now - (client.nextSlot + client.slotUs)) > 0) {
+            client.nextSlot += client.periodUs;
+        }
+
+        if ((int32_t)(now + duration - client.nextSlot) > 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool I2CBus::fitsBetweenSlots(int client, const struct Transaction &transaction) {
+    Priority priority = _clients[client].stats.priority;
+    uint32_t duration = this->estimateUs(transaction.writeLength, transaction.readLength);
+
+    // Anything longer could never run without overlapping a slot
+    for (int i = 0; i < _clientCount; i++) {
+        if (_clients[i].periodUs != 0 && _clients[i].stats.priority < priority &&
+            duration + _clients[i].slotUs >= _clients[i].periodUs) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void I2CBus::execute(struct Transaction &transaction) {
+    struct Client &client = _clients[transaction.client];
+    uint32_t start = us_ticker_read();
+    uint32_t wait = start - transaction.queuedAt;
+    int result = 0;
+
+    if (wait > client.stats.maxWaitUs) {
+        client.stats.maxWaitUs = wait;
+    }
+
+    if (transaction.deadline != 0 && (int32_t)(start - transaction.deadline) > 0) {
+        client.stats.deadlineMisses++;
+    }
+
+    if (transaction.writeLength > 0) {
+        result = _i2c.write(transaction.address, transaction.writeData, transaction.writeLength,
+                            transaction.repeatedStart && transaction.readLength > 0);
+    }
+
+    if (result == 0 && transaction.readLength > 0) {
+        result = _i2c.read(transaction.address, transaction.readData, transaction.readLength);
+    }
+
+    if (client.periodUs != 0) {
+        client.nextSlot = start + client.periodUs;
+    }
+
+    client.stats.busyUs += us_ticker_read() - start;
+    client.stats.transactions++;
+    if (result != 0) {
+        client.stats.errors++;
+    }
+
+    transaction.result = result;
+    transaction.done = true;
+
+    if (transaction.onDone) {
+        transaction.onDone(result);
+    }
+}
+
+int I2CBus::transfer(int client, char address, const char *writeData, int writeLength,
+                     char *readData, int readLength, bool repeatedStart, uint32_t deadline) {
+    struct Transaction transaction;
+
+    // Waiting would never end: an ISR cannot dispatch, and inside dispatch()
+    // (an onDone callback) the dispatcher is waiting for the caller to return
+    if (core_util_is_isr_active() || this->insideDispatch()) {
+        ZLOG_ERROR("Blocking I2C transfer from an ISR or I2C callback refused.");
+        return -1;
+    }
+
+    transaction.address = address;
+    transaction.writeData = writeData;
+    transaction.writeLength = writeLength;
+    transaction.readData = readData;
+    transaction.readLength = readLength;
+    transaction.repeatedStart = repeatedStart;
+    transaction.deadline = deadline;
+
+    if (!this->submit(client, transaction)) {
+        return -1;
+    }
+
+    while (!transaction.done) {
+        this->dispatch();
+    }
+
+    return transaction.result;
+}
+
+int I2CBus::write(int client, char address, const char *data, int length) {
+    return this->transfer(client, address, data, length, NULL, 0);
+}
+
+int I2CBus::read(int client, char address, char *data, int length) {
+    return this->transfer(client, address, NULL, 0, data, length);
+}
+
+I2C &I2CBus::getI2C() {
+    return _i2c;
+}
+
+int I2CBus::getFrequency() {
+    return _frequency;
+}
+
+void I2CBus::setFrequency(int hz) {
+    _frequency = hz;
+    _i2c.frequency(hz);
+}
+
+uint32_t I2CBus::estimateUs(int writeLength, int readLength) {
+    // 9 clocks per byte including the address bytes, plus start/stop
+    uint32_t clocks = 2;
+
+    if (writeLength > 0) {
+        clocks += 9 * (1 + writeLength);
+    }
+
+    if (readLength > 0) {
+        clocks += 9 * (1 + readLength);
+    }
+
+    return (clocks * 1000000u + _frequency - 1) / _frequency;
+}
+
+struct I2CBus::ClientStats I2CBus::getStats(int client) {
+    return _clients[client].stats;
+}
+
+float I2CBus::getUtilisation(int client) {
+    uint32_t elapsed = us_ticker_read() - _statsSince;
+
+    return elapsed ? (float)_clients[client].stats.busyUs / elapsed : 0.0f;
+}
+
+float I2CBus::getTotalUtilisation() {
+    float total = 0.0f;
+
+    for (int i = 0; i < _clientCount; i++) {
+        total += this->getUtilisation(i);
+    }
+
+    return total;
+}
+
+void I2CBus::resetStats() {
+    for (int i = 0; i < _clientCount; i++) {
+        _clients[i].stats.transactions = 0;
+        _clients[i].stats.errors = 0;
+        _clients[i].stats.deadlineMisses = 0;
+        _clients[i].stats.busyUs = 0;
+        _clients[i].stats.maxWaitUs = 0;
+    }
+
+    _statsSince = us_ticker_read();
+}
+
+void I2CBus::printStats() {
+    printf("I2C bus utilisation %.1f%%\n", this->getTotalUtilisation() * 100.0f);
+
+    for (int i = 0; i < _clientCount; i++) {
+        struct ClientStats &stats = _clients[i].stats;
+
+        printf("%-12s prio %d: %lu transactions, %lu errors, %lu missed deadlines, "
+               "busy %.1f%%, max wait %lu us\n",
+               stats.name, (int)stats.priority,
+               (unsigned long)stats.transactions, (unsigned long)stats.errors,
+               (unsigned long)stats.deadlineMisses, this->getUtilisation(i) * 100.0f,
+               (unsigned long)stats.maxWaitUs);
+    }
+}
+
+} // namespace metromotive
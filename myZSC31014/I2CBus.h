@@ -0,0 +1,134 @@
+// Copyright 2023 prisma
+
+#ifndef I2CBUS_H
+#define I2CBUS_H
+
+#include "mbed.h"
+#include <stdint.h>
+
+#ifndef I2CBUS_MAX_CLIENTS
+#define I2CBUS_MAX_CLIENTS 8
+#endif
+
+#ifndef I2CBUS_QUEUE_LENGTH
+#define I2CBUS_QUEUE_LENGTH 16
+#endif
+
+namespace metromotive {
+
+// Transaction scheduler shared by all drivers on one I2C bus.
+//
+// Transactions are queued and run back-to-back, most urgent first: by client
+// priority, then earliest deadline, then submission order. A periodic client
+// (e.g. the load-cell read) can reserve its time slot; lower priority
+// transactions that would still be on the bus when the slot opens are held
+// back until it has been served, so a long EEPROM transfer cannot delay it.
+// submit() refuses a transfer too long to fit between two such slots; split
+// it into smaller transfers.
+//
+// submit() may be called from a Ticker callback; dispatch() runs the blocking
+// transfers and only works from thread context (the main loop or a thread),
+// in an ISR it returns at once. If the bus is already running a transaction
+// the new one is picked up as soon as it ends.
+class I2CBus {
+public:
+    I2CBus(I2C &i2c, int frequency = 100000);
+
+    enum class Priority {
+        realtime = 0,
+        high = 1,
+        normal = 2,
+        background = 3
+    };
+
+    struct Transaction {
+        char address; // 8-bit address
+        const char *writeData;
+        int writeLength;
+        char *readData;
+        int readLength;
+        bool repeatedStart; // read after write without a stop in between
+        uint32_t deadline;  // us ticker, 0 for none
+        Callback<void(int)> onDone; // optional, called with the result
+
+        // Filled in by the scheduler
+        volatile bool done;
+        volatile int result; // 0 on success
+        int client;
+        uint32_t sequence;
+        uint32_t queuedAt;
+    };
+
+    struct ClientStats {
+        const char *name;
+        Priority priority;
+        uint32_t transactions;
+        uint32_t errors;
+        uint32_t deadlineMisses;
+        uint32_t busyUs;
+        uint32_t maxWaitUs;
+    };
+
+    // Returns a client id, or -1 if all slots are taken
+    int addClient(const char *name, Priority priority);
+
+    // Hold lower priority work back around this client's periodic slot
+    void reserve(int client, uint32_t periodUs, uint32_t durationUs);
+
+    bool submit(int client, struct Transaction &transaction);
+    void dispatch();
+    int pending();
+
+    // Blocking helpers: queue, then dispatch until this transaction is done.
+    // Thread context only; from an ISR or an onDone callback they return -1
+    // without queueing (use submit() with onDone there)
+    int transfer(int client, char address, const char *writeData, int writeLength,
+                 char *readData, int readLength, bool repeatedStart = false, uint32_t deadline = 0);
+    int write(int client, char address, const char *data, int length);
+    int read(int client, char address, char *data, int length);
+
+    I2C &getI2C();
+    int getFrequency();
+    void setFrequency(int hz); // only while no transfer is queued or running
+    uint32_t estimateUs(int writeLength, int readLength);
+
+    struct ClientStats getStats(int client);
+    float getUtilisation(int client); // share of wall time since resetStats()
+    float getTotalUtilisation();
+    void resetStats();
+    void printStats();
+
+private:
+    struct Client {
+        struct ClientStats stats;
+        uint32_t periodUs;
+        uint32_t slotUs;
+        uint32_t nextSlot; // us ticker, valid when periodUs != 0
+    };
+
+    I2C &_i2c;
+    int _frequency;
+
+    struct Client _clients[I2CBUS_MAX_CLIENTS];
+    int _clientCount;
+
+    struct Transaction *_queue[I2CBUS_QUEUE_LENGTH];
+    int _queued;
+    uint32_t _sequence;
+    volatile bool _running;
+#if MBED_CONF_RTOS_PRESENT
+    osThreadId_t _dispatcher; // valid while _running
+#endif
+    uint32_t _statsSince;
+
+    struct Transaction *takeNext(bool &blocked);
+    bool isBefore(const struct Transaction &a, const struct Transaction &b);
+    bool insideDispatch();
+    bool collidesWithSlot(const struct Transaction &transaction, uint32_t now);
+    bool fitsBetweenSlots(int client, const struct Transaction &transaction);
+    void execute(struct Transaction &transaction);
+};
+
+} // namespace metromotive
+
+#endif //I2CBUS_H
@@ -0,0 +1,208 @@
+// Copyright 2023 prisma
+
+#include "LoadPlatform.h"
+#include <math.h>
+
+namespace metromotive {
+
+LoadPlatform::LoadPlatform(uint32_t skewWindowUs) :
+    _cellCount(0),
+    _skewWindowUs(skewWindowUs),
+    _sumWeight(0.0f),
+    _sumMomentX(0.0f),
+    _sumMomentY(0.0f),
+    _windowHead(0),
+    _windowFill(0)
+{
+    _last.weight = 0.0f;
+    _last.copX = 0.0f;
+    _last.copY = 0.0f;
+    _last.timestamp = 0;
+    _last.skew = 0;
+    _last.valid = false;
+
+    this->resetSkewStats();
+}
+
+int LoadPlatform::addCell(ZSC31014 &cell, float x, float y) {
+    if (_cellCount >= PLATFORM_MAX_CELLS) {
+        printf("Platform full, cell not added.\n");
+        return -1;
+    }
+
+    _cells[_cellCount].sensor = &cell;
+    _cells[_cellCount].x = x;
+    _cells[_cellCount].y = y;
+    _cells[_cellCount].value = 0.0f;
+
+    return _cellCount++;
+}
+
+int LoadPlatform::getCellCount() {
+    return _cellCount;
+}
+
+float LoadPlatform::getCellValue(int index) {
+    return _cells[index].value;
+}
+
+bool LoadPlatform::readCells(uint32_t &timestamp, uint32_t &skew) {
+    bool ok = true;
+    uint32_t lastStart = 0;
+
+    // Back-to-back reads, nothing else between them; each cell's own calibration
+    // is applied afterwards so it does not widen the skew.
+    uint16_t words[PLATFORM_MAX_CELLS];
+    bool answered[PLATFORM_MAX_CELLS];
+
+    timestamp = us_ticker_read();
+    for (int i = 0; i < _cellCount; i++) {
+        // Repeated start into the next cell's read when it is on the same bus
+        bool chain = i + 1 < _cellCount && _cells[i].sensor->sharesBus(*_cells[i + 1].sensor);
+
+        lastStart = us_ticker_read();
+        answered[i] = _cells[i].sensor->read_raw_word(words[i], chain);
+    }
+    skew = lastStart - timestamp;
+
+    for (int i = 0; i < _cellCount; i++) {
+        uint8_t status;
+
+        if (!answered[i]) {
+            ok = false; // keeps its last value
+            continue;
+        }
+
+        _cells[i].sensor->correct_block(&words[i], 1, &_cells[i].value, &status);
+
+        if (status == (uint8_t)ZSC31014::Status::commandMode ||
+            status == (uint8_t)ZSC31014::Status::diagnostic) {
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+bool LoadPlatform::sample(struct Sample &result) {
+    uint32_t timestamp = 0;
+    uint32_t skew = 0;
+    bool ok = false;
+
+    for (int attempt = 0; attempt <= PLATFORM_SKEW_RETRIES; attempt++) {
+        ok = this->readCells(timestamp, skew);
+        if (skew <= _skewWindowUs) {
+            break;
+        }
+    }
+
+    // Outside the chained reads, so a power cycle does not widen the skew
+    for (int i = 0; i < _cellCount; i++) {
+        _cells[i].sensor->serviceHealth();
+    }
+
+    _skewLast = skew;
+    if (skew > _skewMax) {
+        _skewMax = skew;
+    }
+    _skewTotal += skew;
+    _skewPeriods++;
+    if (skew > _skewWindowUs) {
+        _skewViolations++;
+    }
+
+    float weight = 0.0f;
+    float momentX = 0.0f;
+    float momentY = 0.0f;
+
+    for (int i = 0; i < _cellCount; i++) {
+        weight += _cells[i].value;
+        momentX += _cells[i].value * _cells[i].x;
+        momentY += _cells[i].value * _cells[i].y;
+    }
+
+    result.weight = weight;
+    result.copX = (fabsf(weight) > 1e-6f) ? momentX / weight : 0.0f;
+    result.copY = (fabsf(weight) > 1e-6f) ? momentY / weight : 0.0f;
+    result.timestamp = timestamp;
+    result.skew = skew;
+    result.valid = ok && skew <= _skewWindowUs;
+
+    if (result.valid) {
+        this->push(weight, momentX, momentY);
+    }
+
+    _last = result;
+
+    return result.valid;
+}
+
+void LoadPlatform::push(float weight, float momentX, float momentY) {
+    if (_windowFill == PLATFORM_WINDOW) {
+        _sumWeight -= _weights[_windowHead];
+        _sumMomentX -= _momentsX[_windowHead];
+        _sumMomentY -= _momentsY[_windowHead];
+    } else {
+        _windowFill++;
+    }
+
+    _weights[_windowHead] = weight;
+    _momentsX[_windowHead] = momentX;
+    _momentsY[_windowHead] = momentY;
+    _sumWeight += weight;
+    _sumMomentX += momentX;
+    _sumMomentY += momentY;
+
+    _windowHead++;
+    if (_windowHead == PLATFORM_WINDOW) {
+        _windowHead = 0;
+
+        // Re-sum once per window so float rounding in the running sums cannot accumulate
+        _sumWeight = 0.0f;
+        _sumMomentX = 0.0f;
+        _sumMomentY = 0.0f;
+        for (int i = 0; i < PLATFORM_WINDOW; i++) {
+            _sumWeight += _weights[i];
+            _sumMomentX += _momentsX[i];
+            _sumMomentY += _momentsY[i];
+        }
+    }
+}
+
+struct LoadPlatform::Sample LoadPlatform::getAverage() {
+    struct Sample result = _last;
+
+    if (_windowFill == 0) {
+        result.valid = false;
+        return result;
+    }
+
+    result.weight = _sumWeight / _windowFill;
+    result.copX = (fabsf(_sumWeight) > 1e-6f) ? _sumMomentX / _sumWeight : 0.0f;
+    result.copY = (fabsf(_sumWeight) > 1e-6f) ? _sumMomentY / _sumWeight : 0.0f;
+    result.valid = true;
+
+    return result;
+}
+
+struct LoadPlatform::SkewStats LoadPlatform::getSkewStats() {
+    struct SkewStats result;
+
+    result.last = _skewLast;
+    result.max = _skewMax;
+    result.mean = _skewPeriods ? (float)_skewTotal / _skewPeriods : 0.0f;
+    result.periods = _skewPeriods;
+    result.violations = _skewViolations;
+
+    return result;
+}
+
+void LoadPlatform::resetSkewStats() {
+    _skewLast = 0;
+    _skewMax = 0;
+    _skewTotal = 0;
+    _skewPeriods = 0;
+    _skewViolations = 0;
+}
+
+} // namespace metromotive
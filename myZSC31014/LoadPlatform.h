@@ -0,0 +1,95 @@
+// Copyright 2023 prisma
+
+#ifndef LOADPLATFORM_H
+#define LOADPLATFORM_H
+
+#include "mbed.h"
+#include "ZSC31014.h"
+#include <stdint.h>
+
+#ifndef PLATFORM_MAX_CELLS
+#define PLATFORM_MAX_CELLS 4
+#endif
+
+// Periods in the moving average returned by getAverage()
+#ifndef PLATFORM_WINDOW
+#define PLATFORM_WINDOW 16
+#endif
+
+// Extra attempts when a period exceeds the skew window
+#ifndef PLATFORM_SKEW_RETRIES
+#define PLATFORM_SKEW_RETRIES 2
+#endif
+
+namespace metromotive {
+
+// Aggregates several ZSC31014 cells (e.g. one per platform corner) into total
+// weight and center of pressure. Each cell keeps its own calibration and bias.
+class LoadPlatform {
+public:
+    LoadPlatform(uint32_t skewWindowUs = 1000);
+
+    struct Sample {
+        float weight;       // sum of the calibrated cell outputs
+        float copX;         // center of pressure, in the units of the cell positions
+        float copY;
+        uint32_t timestamp; // us ticker at the first cell read
+        uint32_t skew;      // us from the first to the last cell read
+        bool valid;         // all cells answered with data, inside the skew window
+    };
+
+    struct SkewStats {
+        uint32_t last;
+        uint32_t max;
+        float mean;
+        uint32_t periods;
+        uint32_t violations; // periods still outside the window after retries
+    };
+
+    // Returns the cell index, or -1 if the platform is full
+    int addCell(ZSC31014 &cell, float x, float y);
+    int getCellCount();
+    float getCellValue(int index); // last calibrated value of one cell
+
+    bool sample(struct Sample &result); // one sample period, returns result.valid
+    struct Sample getAverage();         // over the last PLATFORM_WINDOW valid periods
+
+    struct SkewStats getSkewStats();
+    void resetSkewStats();
+
+private:
+    struct Cell {
+        ZSC31014 *sensor;
+        float x;
+        float y;
+        float value;
+    };
+
+    struct Cell _cells[PLATFORM_MAX_CELLS];
+    int _cellCount;
+    uint32_t _skewWindowUs;
+
+    // Moving window of weight and first moments, running sums updated in O(1)
+    float _weights[PLATFORM_WINDOW];
+    float _momentsX[PLATFORM_WINDOW];
+    float _momentsY[PLATFORM_WINDOW];
+    float _sumWeight;
+    float _sumMomentX;
+    float _sumMomentY;
+    int _windowHead;
+    int _windowFill;
+    struct Sample _last;
+
+    uint32_t _skewLast;
+    uint32_t _skewMax;
+    uint64_t _skewTotal;
+    uint32_t _skewPeriods;
+    uint32_t _skewViolations;
+
+    bool readCells(uint32_t &timestamp, uint32_t &skew);
+    void push(float weight, float momentX, float momentY);
+};
+
+} // namespace metromotive
+
+#endif //LOADPLATFORM_H
@@ -0,0 +1,242 @@
+// Copyright 2023 prisma
+
+#ifndef LOWPOWERSAMPLER_H
+#define LOWPOWERSAMPLER_H
+
+#include "ZSC31014.h"
+#include "ZSC31014Policies.h"
+#include <stdint.h>
+
+// Power-on to end of the command window, after which conversions start
+#ifndef LOWPOWER_STARTUP_US_4MHZ
+#define LOWPOWER_STARTUP_US_4MHZ 3000
+#endif
+
+#ifndef LOWPOWER_STARTUP_US_1MHZ
+#define LOWPOWER_STARTUP_US_1MHZ 10000
+#endif
+
+// Poll interval while waiting for the first fresh conversion
+#ifndef LOWPOWER_POLL_US
+#define LOWPOWER_POLL_US 100
+#endif
+
+namespace metromotive {
+
+// Duty-cycled acquisition for battery scales sampling at 1-10 Hz. Each slot
+// powers the bridge through the driver's power pin only until the first
+// fresh conversion is available, reads it, powers down and lets the MCU
+// sleep until the next slot.
+//
+// Sensor: powerUp(), powerDown(), bool read_raw_word(uint16_t &), correct_block(),
+//         serviceHealth()
+//         (ZSC31014, ZSC31014Core)
+// Clock:  void start(); int read_us(); (mbed Timer/LowPowerTimer, SimTimer)
+// Delay:  static void us(uint32_t us); static void ms(uint32_t ms);
+//
+// LowPowerSampler is the mbed combination; tools/check_lowpower.cpp runs it
+// on the simulator.
+template <class Sensor, class Clock, class Delay>
+class LowPowerSamplerT {
+public:
+    // clockSpeed and updateRate as programmed in ZMDI_Config1
+    LowPowerSamplerT(Sensor &sensor, float rate,
+                     ZSC31014::ClockSpeed clockSpeed = ZSC31014::ClockSpeed::mhz4,
+                     ZSC31014::UpdateRate updateRate = ZSC31014::UpdateRate::fastest) :
+        _sensor(sensor),
+        _periodUs(1000000.0f / rate),
+        _startupUs(startupUs(clockSpeed)),
+        _conversionUs(conversionUs(clockSpeed, updateRate)),
+        _started(false),
+        _nextSlot(0)
+    {
+        // Give up on a slot if no fresh conversion shows up well past the expected time
+        _timeoutUs = _startupUs + 3 * _conversionUs + 1000;
+
+        _sensor.powerDown();
+        _clock.start();
+        this->resetStats();
+    }
+
+    struct Sample {
+        uint16_t raw;
+        float value;
+        uint8_t status;
+        uint32_t onTimeUs; // bridge powered, power-up to power-down
+        bool valid;
+    };
+
+    struct Stats {
+        uint32_t samples;
+        uint32_t failures; // no fresh conversion, or no answer, before the timeout
+        uint32_t lastOnTimeUs;
+        uint32_t maxOnTimeUs;
+        float meanOnTimeUs;
+        float dutyCycle; // mean on-time over the period
+    };
+
+    static uint32_t conversionUs(ZSC31014::ClockSpeed clockSpeed, ZSC31014::UpdateRate updateRate) {
+        // Update periods from the ZSC31014::UpdateRate table, 1MHz clock / 4MHz clock
+        static const uint32_t mhz1[] = { 1600, 5000, 25000, 125000 };
+        static const uint32_t mhz4[] = { 500, 1500, 6500, 32000 };
+
+        int index = (int)updateRate;
+
+        return (clockSpeed == ZSC31014::ClockSpeed::mhz1) ? mhz1[index] : mhz4[index];
+    }
+
+    static uint32_t startupUs(ZSC31014::ClockSpeed clockSpeed) {
+        return (clockSpeed == ZSC31014::ClockSpeed::mhz1) ? LOWPOWER_STARTUP_US_1MHZ : LOWPOWER_STARTUP_US_4MHZ;
+    }
+
+    uint32_t getExpectedOnTimeUs() {
+        return _startupUs + _conversionUs;
+    }
+
+    // Longest a slot keeps the bridge powered waiting for a fresh conversion
+    uint32_t getTimeoutUs() {
+        return _timeoutUs;
+    }
+
+    uint32_t getPeriodUs() {
+        return _periodUs;
+    }
+
+    // One power-up, conversion, read, power-down cycle
+    bool acquire(struct Sample &sample) {
+        // A due recovery leaves the bridge powered, so run it ahead of the slot
+        _sensor.serviceHealth();
+
+        uint32_t start = _clock.read_us();
+        uint16_t word = 0;
+
+        _sensor.powerUp();
+
+        // Nothing valid can come out before the first conversion ends
+        this->sleepUntil(start + _startupUs + _conversionUs);
+
+        sample.valid = false;
+        while (true) {
+            // A chip that does not acknowledge yet is polled like one that
+            // has no fresh conversion; its zeroed word must not pass as valid
+            bool answered = _sensor.read_raw_word(word);
+
+            if (answered && (word >> 14) == (uint16_t)ZSC31014::Status::valid) {
+                sample.valid = true;
+                break;
+            }
+
+            if (!answered) {
+                word = 0xFFFF; // what an undriven bus reads, diagnostic status
+            }
+
+            if ((uint32_t)_clock.read_us() - start > _timeoutUs) {
+                break;
+            }
+
+            Delay::us(LOWPOWER_POLL_US);
+        }
+
+        _sensor.powerDown();
+
+        sample.onTimeUs = (uint32_t)_clock.read_us() - start;
+        sample.raw = word & 0x3FFF;
+        _sensor.correct_block(&word, 1, &sample.value, &sample.status);
+
+        _samples++;
+        if (!sample.valid) {
+            _failures++;
+        }
+        _lastOnTimeUs = sample.onTimeUs;
+        if (sample.onTimeUs > _maxOnTimeUs) {
+            _maxOnTimeUs = sample.onTimeUs;
+        }
+        _totalOnTimeUs += sample.onTimeUs;
+
+        return sample.valid;
+    }
+
+    // Sleep until the next slot, then acquire
+    bool next(struct Sample &sample) {
+        uint32_t now = _clock.read_us();
+
+        if (!_started) {
+            _nextSlot = now;
+            _started = true;
+        }
+
+        // Skip slots that have already passed rather than sampling in a burst
+        while ((int32_t)(now - _nextSlot) > (int32_t)_periodUs) {
+            _nextSlot += _periodUs;
+        }
+
+        this->sleepUntil(_nextSlot);
+        _nextSlot += _periodUs;
+
+        return this->acquire(sample);
+    }
+
+    struct Stats getStats() {
+        struct Stats stats;
+
+        stats.samples = _samples;
+        stats.failures = _failures;
+        stats.lastOnTimeUs = _lastOnTimeUs;
+        stats.maxOnTimeUs = _maxOnTimeUs;
+        stats.meanOnTimeUs = _samples ? (float)_totalOnTimeUs / _samples : 0.0f;
+        stats.dutyCycle = stats.meanOnTimeUs / _periodUs;
+
+        return stats;
+    }
+
+    void resetStats() {
+        _samples = 0;
+        _failures = 0;
+        _lastOnTimeUs = 0;
+        _maxOnTimeUs = 0;
+        _totalOnTimeUs = 0;
+    }
+
+private:
+    Sensor &_sensor;
+    uint32_t _periodUs;
+    uint32_t _startupUs;
+    uint32_t _conversionUs;
+    uint32_t _timeoutUs;
+
+    Clock _clock; // must keep running while the MCU sleeps
+    bool _started;
+    uint32_t _nextSlot;
+
+    uint32_t _samples;
+    uint32_t _failures;
+    uint32_t _lastOnTimeUs;
+    uint32_t _maxOnTimeUs;
+    uint64_t _totalOnTimeUs;
+
+    void sleepUntil(uint32_t time) {
+        int32_t remaining = (int32_t)(time - (uint32_t)_clock.read_us());
+
+        // Whole milliseconds with the MCU asleep, the rest busy-waiting
+        if (remaining >= 1000) {
+            Delay::ms(remaining / 1000);
+            remaining = (int32_t)(time - (uint32_t)_clock.read_us());
+        }
+
+        if (remaining > 0) {
+            Delay::us(remaining);
+        }
+    }
+};
+
+#if defined(__MBED__)
+#if DEVICE_LPTICKER
+typedef LowPowerSamplerT<ZSC31014, LowPowerTimer, MbedDelay> LowPowerSampler;
+#else
+typedef LowPowerSamplerT<ZSC31014, Timer, MbedDelay> LowPowerSampler;
+#endif
+#endif
+
+} // namespace metromotive
+
+#endif //LOWPOWERSAMPLER_H
@@ -0,0 +1,269 @@
+// Copyright 2023 prisma
+
+#include "NoiseAnalyzer.h"
+#include <math.h>
+#include <stdio.h>
+
+namespace metromotive {
+
+static const float twoPi = 6.28318530718f;
+
+NoiseAnalyzer::NoiseAnalyzer(float samplePeriod) :
+    _samplePeriod(samplePeriod)
+{
+    _windowPower = 0.0f;
+    for (int i = 0; i < fftSize; i++) {
+        _window[i] = 0.5f - 0.5f * cosf(twoPi * i / fftSize); // periodic Hann
+        _windowPower += _window[i] * _window[i];
+    }
+
+    for (int i = 0; i < fftSize / 2; i++) {
+        _cos[i] = cosf(twoPi * i / fftSize);
+        _sin[i] = -sinf(twoPi * i / fftSize);
+    }
+
+    this->reset();
+}
+
+void NoiseAnalyzer::reset() {
+    _count = 0;
+
+    _segmentHead = 0;
+    _sinceLastSegment = 0;
+    _segments = 0;
+    for (int i = 0; i <= fftSize / 2; i++) {
+        _psd[i] = 0.0f;
+    }
+
+    _sum = 0;
+    _cumsum[0] = 0;
+    for (int k = 0; k < octaves; k++) {
+        _adevAccum[k] = 0.0;
+        _adevCount[k] = 0;
+    }
+}
+
+void NoiseAnalyzer::setSamplePeriod(float samplePeriod) {
+    _samplePeriod = samplePeriod;
+}
+
+float NoiseAnalyzer::getSamplePeriod() {
+    return _samplePeriod;
+}
+
+uint32_t NoiseAnalyzer::getSampleCount() {
+    return _count;
+}
+
+void NoiseAnalyzer::addSample(uint16_t raw) {
+    _count++;
+
+    // PSD: keep the last fftSize samples, transform every fftSize/2 (50% overlap)
+    _segment[_segmentHead] = raw;
+    _segmentHead = (_segmentHead + 1) & (fftSize - 1);
+    _sinceLastSegment++;
+
+    if (_count >= (uint32_t)fftSize && _sinceLastSegment >= fftSize / 2) {
+        this->processSegment();
+        _sinceLastSegment = 0;
+    }
+
+    // Overlapping Allan deviation from cumulative sums S[n]:
+    // the two adjacent m-sample means are (S[n] - S[n-m]) / m and (S[n-m] - S[n-2m]) / m.
+    _sum += raw;
+
+    for (int k = 0; k < octaves; k++) {
+        uint32_t m = 1u << k;
+
+        if (_count < 2 * m) {
+            break;
+        }
+
+        uint32_t mid = _cumsum[(_count - m) & (historySize - 1)];
+        uint32_t old = _cumsum[(_count - 2 * m) & (historySize - 1)];
+        int32_t delta = (int32_t)((_sum - mid) - (mid - old));
+        double diff = (double)delta / (double)m;
+
+        _adevAccum[k] += diff * diff;
+        _adevCount[k]++;
+    }
+
+    // Written last: for the largest octave S[n-2m] shares this slot
+    _cumsum[_count & (historySize - 1)] = _sum;
+}
+
+void NoiseAnalyzer::processSegment() {
+    float mean = 0.0f;
+    for (int i = 0; i < fftSize; i++) {
+        mean += _segment[i];
+    }
+    mean /= fftSize;
+
+    // _segmentHead points at the oldest sample
+    for (int i = 0; i < fftSize; i++) {
+        _re[i] = (_segment[(_segmentHead + i) & (fftSize - 1)] - mean) * _window[i];
+        _im[i] = 0.0f;
+    }
+
+    this->fft();
+
+    for (int i = 0; i <= fftSize / 2; i++) {
+        float power = _re[i] * _re[i] + _im[i] * _im[i];
+        _psd[i] += (i == 0 || i == fftSize / 2) ? power : 2.0f * power;
+    }
+
+    _segments++;
+}
+
+void NoiseAnalyzer::fft() {
+    // Bit reversal permutation
+    for (int i = 1, j = 0; i < fftSize; i++) {
+        int bit = fftSize >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+
+        if (i < j) {
+            float t = _re[i];
+            _re[i] = _re[j];
+            _re[j] = t;
+            t = _im[i];
+            _im[i] = _im[j];
+            _im[j] = t;
+        }
+    }
+
+    // Radix-2 butterflies
+    for (int len = 2; len <= fftSize; len <<= 1) {
+        int half = len >> 1;
+        int step = fftSize / len;
+
+        for (int i = 0; i < fftSize; i += len) {
+            for (int j = 0; j < half; j++) {
+                float wr = _cos[j * step];
+                float wi = _sin[j * step];
+                int a = i + j;
+                int b = a + half;
+
+                float tr = _re[b] * wr - _im[b] * wi;
+                float ti = _re[b] * wi + _im[b] * wr;
+
+                _re[b] = _re[a] - tr;
+                _im[b] = _im[a] - ti;
+                _re[a] += tr;
+                _im[a] += ti;
+            }
+        }
+    }
+}
+
+int NoiseAnalyzer::getPSDLength() {
+    return fftSize / 2 + 1;
+}
+
+int NoiseAnalyzer::getSegmentCount() {
+    return _segments;
+}
+
+float NoiseAnalyzer::getFrequency(int bin) {
+    return bin / (fftSize * _samplePeriod);
+}
+
+float NoiseAnalyzer::getPSD(int bin) {
+    if (_segments == 0 || bin < 0 || bin > fftSize / 2) {
+        return 0.0f;
+    }
+
+    return _psd[bin] * _samplePeriod / (_windowPower * _segments);
+}
+
+float NoiseAnalyzer::getNoiseDensity() {
+    float sum = 0.0f;
+    int bins = 0;
+
+    for (int i = fftSize / 4; i < fftSize / 2; i++) {
+        sum += this->getPSD(i);
+        bins++;
+    }
+
+    return sqrtf(sum / bins);
+}
+
+int NoiseAnalyzer::getAllanLength() {
+    int length = 0;
+    while (length < octaves && _adevCount[length] > 0) {
+        length++;
+    }
+    return length;
+}
+
+int NoiseAnalyzer::getAllanDecimation(int octave) {
+    return 1 << octave;
+}
+
+float NoiseAnalyzer::getAllanTau(int octave) {
+    return (1 << octave) * _samplePeriod;
+}
+
+float NoiseAnalyzer::getAllanDeviation(int octave) {
+    if (octave < 0 || octave >= octaves || _adevCount[octave] == 0) {
+        return 0.0f;
+    }
+
+    return (float)sqrt(_adevAccum[octave] / (2.0 * _adevCount[octave]));
+}
+
+struct NoiseAnalyzer::Recommendation NoiseAnalyzer::recommend(float targetNoise) {
+    struct Recommendation result;
+    int length = this->getAllanLength();
+    int best = 0;
+
+    result.targetReached = false;
+
+    for (int k = 0; k < length; k++) {
+        if (this->getAllanDeviation(k) <= targetNoise) {
+            best = k;
+            result.targetReached = true;
+            break;
+        }
+
+        // Past the minimum, drift dominates and averaging longer does not help
+        if (this->getAllanDeviation(k) < this->getAllanDeviation(best)) {
+            best = k;
+        }
+    }
+
+    result.decimation = this->getAllanDecimation(best);
+    result.averagingTime = this->getAllanTau(best);
+    result.deviation = this->getAllanDeviation(best);
+
+    return result;
+}
+
+void NoiseAnalyzer::printReport(float targetNoise) {
+    printf("Noise report: %lu samples, period %f s, %d PSD segments\n",
+           (unsigned long)_count, _samplePeriod, _segments);
+    printf("White noise density: %f counts/sqrt(Hz)\n", this->getNoiseDensity());
+
+    printf("tau [s]     m      adev [counts]\n");
+    for (int k = 0; k < this->getAllanLength(); k++) {
+        printf("%-10f  %-5d  %f\n",
+               this->getAllanTau(k),
+               this->getAllanDecimation(k),
+               this->getAllanDeviation(k));
+    }
+
+    struct Recommendation recommendation = this->recommend(targetNoise);
+
+    if (recommendation.targetReached) {
+        printf("Target %f counts reached: average %d samples (%f s)\n",
+               targetNoise, recommendation.decimation, recommendation.averagingTime);
+    } else {
+        printf("Target %f counts not reached: best %f counts averaging %d samples (%f s)\n",
+               targetNoise, recommendation.deviation,
+               recommendation.decimation, recommendation.averagingTime);
+    }
+}
+
+} // namespace metromotive
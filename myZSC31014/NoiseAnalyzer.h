@@ -0,0 +1,91 @@
+// Copyright 2023 prisma
+
+#ifndef NOISEANALYZER_H
+#define NOISEANALYZER_H
+
+#include <stdint.h>
+
+// Welch PSD segment length (must be a power of two).
+#ifndef NOISE_FFT_SIZE
+#define NOISE_FFT_SIZE 256
+#endif
+
+// Number of Allan deviation octaves, tau = 1, 2, 4 ... 2^(N-1) samples.
+// Costs 4 * 2^N bytes of RAM for the cumulative sum history.
+#ifndef NOISE_ADEV_OCTAVES
+#define NOISE_ADEV_OCTAVES 11
+#endif
+
+namespace metromotive {
+
+// Streaming noise characterization of raw ZSC31014 samples.
+// Has no mbed dependency so it also builds on the host (see tools/noise_report.cpp).
+// About 14 KB with the default sizes: allocate statically, not on the stack.
+class NoiseAnalyzer {
+public:
+    NoiseAnalyzer(float samplePeriod); // seconds between samples
+
+    struct Recommendation {
+        bool targetReached;
+        int decimation;      // samples to average per output value
+        float averagingTime; // decimation * sample period, in seconds
+        float deviation;     // Allan deviation at that averaging time, in counts
+    };
+
+    void reset();
+    void addSample(uint16_t raw);
+
+    void setSamplePeriod(float samplePeriod);
+    float getSamplePeriod();
+    uint32_t getSampleCount();
+
+    // Power spectral density (one-sided, counts^2/Hz), averaged over 50% overlapping segments
+    int getPSDLength();
+    int getSegmentCount();
+    float getFrequency(int bin);
+    float getPSD(int bin);
+    float getNoiseDensity(); // counts/sqrt(Hz), from the upper half of the spectrum
+
+    // Overlapping Allan deviation, in counts
+    int getAllanLength();
+    int getAllanDecimation(int octave);
+    float getAllanTau(int octave);
+    float getAllanDeviation(int octave);
+
+    struct Recommendation recommend(float targetNoise);
+    void printReport(float targetNoise);
+
+private:
+    static const int fftSize = NOISE_FFT_SIZE;
+    static const int octaves = NOISE_ADEV_OCTAVES;
+    static const int historySize = 1 << NOISE_ADEV_OCTAVES;
+
+    float _samplePeriod;
+    uint32_t _count;
+
+    // PSD state
+    uint16_t _segment[fftSize];
+    int _segmentHead;
+    int _sinceLastSegment;
+    int _segments;
+    float _window[fftSize];
+    float _windowPower;
+    float _cos[fftSize / 2];
+    float _sin[fftSize / 2];
+    float _re[fftSize];
+    float _im[fftSize];
+    float _psd[fftSize / 2 + 1];
+
+    // Allan state: cumulative sums wrap modulo 2^32, differences stay exact
+    uint32_t _cumsum[historySize];
+    uint32_t _sum;
+    double _adevAccum[octaves];
+    uint32_t _adevCount[octaves];
+
+    void processSegment();
+    void fft();
+};
+
+} // namespace metromotive
+
+#endif //NOISEANALYZER_H
@@ -0,0 +1,193 @@
+// Copyright 2023 prisma
+
+#include "Provisioner.h"
+
+namespace metromotive {
+
+// Power-on to first conversion, after which the new address is live
+static const int startupMs = 10;
+
+Provisioner::Provisioner(I2C &i2c, DigitalOut *powerPins, int count, char firstAddress) :
+    _i2c(i2c),
+    _powerPins(powerPins),
+    _count(count),
+    _firstAddress(firstAddress)
+{
+    if (_count > PROVISIONER_MAX_DEVICES) {
+        printf("Too many devices to provision, using the first %d.\n", PROVISIONER_MAX_DEVICES);
+        _count = PROVISIONER_MAX_DEVICES;
+    }
+}
+
+struct Provisioner::Profile Provisioner::defaultProfile() {
+    struct Profile profile;
+
+    profile.updateRate = ZSC31014::UpdateRate::fastest;
+    profile.enableSensorConnectionCheck = true;
+    profile.enableSensorShortCheck = true;
+    profile.lockAddress = true; // an unlocked chip answers on every address
+    profile.disableNulling = false;
+    profile.mux = ZSC31014::MuxMode::fullBridge;
+    profile.useBSink = true;
+    profile.useLongIntegration = true;
+    profile.preAmpGain = ZSC31014::PreAmpGain::x192;
+    profile.preAmpOffset = 0b0001;
+    profile.offset = (int16_t)0xE000;
+
+    return profile;
+}
+
+int Provisioner::run(const struct Profile &profile, struct Result *results) {
+    int provisioned = 0;
+    char address = _firstAddress;
+
+    // Everything off, so only the chip being provisioned sits at the default address
+    for (int i = 0; i < _count; i++) {
+        _powerPins[i].write(0);
+    }
+    thread_sleep_for(1);
+
+    for (int i = 0; i < _count; i++) {
+        if (address == defaultAddress) {
+            address++;
+        }
+
+        if (this->provision(i, address, profile, results[i])) {
+            provisioned++;
+        }
+
+        address++;
+    }
+
+    return provisioned;
+}
+
+bool Provisioner::provision(int index, char newAddress, const struct Profile &profile, struct Result &result) {
+    Timer timer;
+    timer.start();
+
+    result.id.lotNumber = 0;
+    result.id.waferNumber = 0;
+    result.id.waferXCoordinate = 0;
+    result.id.waferYCoordinate = 0;
+    result.address = newAddress;
+    result.commandMode = false;
+    result.wordsWritten = 0;
+    result.verified = false;
+    result.answering = false;
+
+    ZSC31014 sensor(_i2c, defaultAddress, _powerPins[index]);
+
+    // Powers this chip up and enters command mode inside the command window
+    sensor.startCommandMode();
+
+    // Every EEPROM word is a legal value, so only the checked read tells a
+    // silent chip apart; writing words derived from a failed read would
+    // corrupt its EEPROM
+    uint16_t config1, config2, bridge, offset, customerID0, customerID1, customerID2;
+    if (!sensor.core.readRegister(ZSC31014::ReadZMDI_Config1, config1) ||
+        !sensor.core.readRegister(ZSC31014::ReadZMDI_Config2, config2) ||
+        !sensor.core.readRegister(ZSC31014::ReadB_Config, bridge) ||
+        !sensor.core.readRegister(ZSC31014::ReadOffset_B, offset) ||
+        !sensor.core.readRegister(ZSC31014::ReadCust_ID0, customerID0) ||
+        !sensor.core.readRegister(ZSC31014::ReadCust_ID1, customerID1) ||
+        !sensor.core.readRegister(ZSC31014::ReadCust_ID2, customerID2)) {
+        _powerPins[index].write(0);
+        result.elapsedUs = timer.read_us();
+        return false;
+    }
+    result.commandMode = true;
+    result.id = sensor.decodeFactoryID(customerID0, customerID1, customerID2);
+
+    struct ZSC31014::ZMDIConfig1 zmdiConfig1 = sensor.decodeZMDIConfig1(config1);
+    zmdiConfig1.updateRate = profile.updateRate;
+
+    struct ZSC31014::ZMDIConfig2 zmdiConfig2 = sensor.decodeZMDIConfig2(config2);
+    zmdiConfig2.enableSensorConnectionCheck = profile.enableSensorConnectionCheck;
+    zmdiConfig2.enableSensorShortCheck = profile.enableSensorShortCheck;
+    zmdiConfig2.slaveAddress = newAddress;
+    zmdiConfig2.lockAddress = profile.lockAddress;
+    zmdiConfig2.lockEEPROM = false;
+
+    struct ZSC31014::BridgeConfig bridgeConfig = sensor.decodeBridgeConfig(bridge);
+    bridgeConfig.disableNulling = profile.disableNulling;
+    bridgeConfig.mux = profile.mux;
+    bridgeConfig.useBSink = profile.useBSink;
+    bridgeConfig.useLongIntegration = profile.useLongIntegration;
+    bridgeConfig.preAmpGain = profile.preAmpGain;
+    bridgeConfig.preAmpOffset = profile.preAmpOffset;
+
+    struct {
+        ZSC31014::Command readCommand;
+        ZSC31014::Command writeCommand;
+        uint16_t current;
+        uint16_t wanted;
+    } words[] = {
+        { ZSC31014::ReadZMDI_Config1, ZSC31014::WriteZMDI_Config1, config1, sensor.encodeZMDIConfig1(zmdiConfig1) },
+        { ZSC31014::ReadZMDI_Config2, ZSC31014::WriteZMDI_Config2, config2, sensor.encodeZMDIConfig2(zmdiConfig2) },
+        { ZSC31014::ReadB_Config, ZSC31014::WriteB_Config, bridge, sensor.encodeBridgeConfig(bridgeConfig) },
+        { ZSC31014::ReadOffset_B, ZSC31014::WriteOffset_B, offset, (uint16_t)profile.offset }
+    };
+    const int wordCount = sizeof(words) / sizeof(words[0]);
+
+    // One write per word, only where it differs, each followed by the programming time
+    for (int i = 0; i < wordCount; i++) {
+        if (words[i].current != words[i].wanted) {
+            sensor.write(words[i].writeCommand, words[i].wanted);
+            result.wordsWritten++;
+            thread_sleep_for(ZSC31014_EEPROM_WRITE_MS);
+        }
+    }
+
+    result.verified = true;
+    for (int i = 0; i < wordCount; i++) {
+        uint16_t value;
+        if (!sensor.core.readRegister(words[i].readCommand, value) || value != words[i].wanted) {
+            result.verified = false;
+        }
+    }
+
+    // The new address takes effect after a restart
+    sensor.startNormalOperationMode();
+    sensor.powerCycle();
+    thread_sleep_for(startupMs);
+
+    char reading[2];
+    result.answering = _i2c.read(newAddress << 1, reading, 2) == 0;
+
+    if (!result.verified || !result.answering) {
+        // Keep a failed chip off the bus, it may still answer at the default address
+        _powerPins[index].write(0);
+    }
+
+    result.elapsedUs = timer.read_us();
+
+    return result.verified && result.answering;
+}
+
+void Provisioner::printReport(const struct Result *results) {
+    uint32_t total = 0;
+
+    printf("dev  lot     wafer  x/y      addr  cmd  written  verified  answering  time [ms]\n");
+    for (int i = 0; i < _count; i++) {
+        const struct Result &result = results[i];
+
+        printf("%-3d  %-6d  %-5d  %3d/%-3d  0x%02x  %-3s  %-7d  %-8s  %-9s  %lu\n",
+               i,
+               result.id.lotNumber,
+               result.id.waferNumber,
+               result.id.waferXCoordinate,
+               result.id.waferYCoordinate,
+               result.address,
+               result.commandMode ? "ok" : "-",
+               result.wordsWritten,
+               result.verified ? "ok" : "FAIL",
+               result.answering ? "ok" : "FAIL",
+               (unsigned long)(result.elapsedUs / 1000));
+        total += result.elapsedUs;
+    }
+
+    printf("%d devices in %lu ms\n", _count, (unsigned long)(total / 1000));
+}
+
+} // namespace metromotive
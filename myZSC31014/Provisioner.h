@@ -0,0 +1,74 @@
+// Copyright 2023 prisma
+
+#ifndef PROVISIONER_H
+#define PROVISIONER_H
+
+#include "mbed.h"
+#include "ZSC31014.h"
+#include <stdint.h>
+
+// Maximum EEPROM programming time per word, with margin
+#ifndef ZSC31014_EEPROM_WRITE_MS
+#define ZSC31014_EEPROM_WRITE_MS 15
+#endif
+
+#ifndef PROVISIONER_MAX_DEVICES
+#define PROVISIONER_MAX_DEVICES 16
+#endif
+
+namespace metromotive {
+
+// Commissions several ZSC31014 on one bus. Every chip starts at the default
+// address, so each one is powered up on its own switched power pin, taken
+// into command mode, given a unique address and the shared profile, verified,
+// and restarted at its new address before the next one is powered.
+class Provisioner {
+public:
+    // Addresses are handed out from firstAddress upwards, skipping the default
+    Provisioner(I2C &i2c, DigitalOut *powerPins, int count, char firstAddress = 0x30);
+
+    // Fields applied on top of what each chip already holds, as in ZSC31014::setup()
+    struct Profile {
+        ZSC31014::UpdateRate updateRate;
+        bool enableSensorConnectionCheck;
+        bool enableSensorShortCheck;
+        bool lockAddress;
+        bool disableNulling;
+        ZSC31014::MuxMode mux;
+        bool useBSink;
+        bool useLongIntegration;
+        ZSC31014::PreAmpGain preAmpGain;
+        int preAmpOffset;
+        int16_t offset;
+    };
+
+    struct Result {
+        struct ZSC31014::FactoryID id;
+        char address;      // 7-bit address assigned
+        bool commandMode;  // answered in command mode at the default address
+        int wordsWritten;  // EEPROM words that differed from the profile
+        bool verified;     // read-back matched
+        bool answering;    // answered at the new address after restart
+        uint32_t elapsedUs;
+    };
+
+    static struct Profile defaultProfile();
+
+    // Returns the number of devices provisioned successfully
+    int run(const struct Profile &profile, struct Result *results);
+    void printReport(const struct Result *results);
+
+private:
+    static const char defaultAddress = 0x28;
+
+    I2C &_i2c;
+    DigitalOut *_powerPins;
+    int _count;
+    char _firstAddress;
+
+    bool provision(int index, char newAddress, const struct Profile &profile, struct Result &result);
+};
+
+} // namespace metromotive
+
+#endif //PROVISIONER_H
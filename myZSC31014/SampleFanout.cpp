@@ -0,0 +1,177 @@
+// Copyright 2023 prisma
+
+#include "SampleFanout.h"
+
+namespace metromotive {
+
+SampleFanout::SampleFanout(float sampleRate) :
+    _sampleRate(sampleRate),
+    _written(0)
+{
+    for (int i = 0; i < FANOUT_MAX_SUBSCRIBERS; i++) {
+        _subscribers[i].active = false;
+    }
+}
+
+int SampleFanout::subscribe(float rate, Filter filter, DropPolicy policy) {
+    for (int i = 0; i < FANOUT_MAX_SUBSCRIBERS; i++) {
+        struct Subscriber &subscriber = _subscribers[i];
+
+        if (subscriber.active) {
+            continue;
+        }
+
+        int decimation = (rate > 0.0f) ? (int)(_sampleRate / rate + 0.5f) : 1;
+
+        if (decimation < 1) {
+            decimation = 1;
+        } else if (decimation > capacity - 1) {
+            return -1; // one output sample must fit in the buffer
+        }
+
+        subscriber.decimation = decimation;
+        subscriber.filter = filter;
+        subscriber.policy = policy;
+        subscriber.cursor = _written.load(std::memory_order_acquire);
+        subscriber.dropped = 0;
+        subscriber.active = true;
+
+        return i;
+    }
+
+    return -1;
+}
+
+void SampleFanout::unsubscribe(int id) {
+    _subscribers[id].active = false;
+}
+
+void SampleFanout::publish(const struct Sample &sample) {
+    uint32_t written = _written.load(std::memory_order_relaxed);
+
+    _buffer[written & (capacity - 1)] = sample;
+    _written.store(written + 1, std::memory_order_release);
+}
+
+void SampleFanout::catchUp(struct Subscriber &subscriber, uint32_t written) {
+    // The slot of index written - capacity may be in the middle of being
+    // overwritten, so only capacity - 1 samples are readable.
+    if (written - subscriber.cursor <= (uint32_t)(capacity - 1)) {
+        return;
+    }
+
+    uint32_t cursor;
+    if (subscriber.policy == DropPolicy::skipToLatest) {
+        cursor = written - 1;
+    } else {
+        cursor = written - (capacity - 1);
+    }
+
+    subscriber.dropped += cursor - subscriber.cursor;
+    subscriber.cursor = cursor;
+}
+
+int SampleFanout::fetch(int id, struct View &view, int maxCount) {
+    struct Subscriber &subscriber = _subscribers[id];
+    uint32_t written = _written.load(std::memory_order_acquire);
+
+    this->catchUp(subscriber, written);
+
+    int count = written - subscriber.cursor;
+    if (count > maxCount) {
+        count = maxCount;
+    }
+
+    int start = subscriber.cursor & (capacity - 1);
+
+    view.first = &_buffer[start];
+    view.firstCount = (count < capacity - start) ? count : capacity - start;
+    view.second = &_buffer[0];
+    view.secondCount = count - view.firstCount;
+
+    return count;
+}
+
+bool SampleFanout::release(int id, int count) {
+    struct Subscriber &subscriber = _subscribers[id];
+
+    // The consumer's reads of the fetched view must complete before the lap check
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint32_t written = _written.load(std::memory_order_relaxed);
+    uint32_t lag = written - subscriber.cursor;
+    uint32_t overwritten = 0;
+
+    if (lag > (uint32_t)(capacity - 1)) {
+        overwritten = lag - (capacity - 1);
+        if (overwritten > (uint32_t)count) {
+            overwritten = count;
+        }
+    }
+
+    subscriber.dropped += overwritten;
+    subscriber.cursor += count;
+
+    return overwritten == 0;
+}
+
+bool SampleFanout::next(int id, struct Sample &out) {
+    struct Subscriber &subscriber = _subscribers[id];
+
+    while (true) {
+        uint32_t written = _written.load(std::memory_order_acquire);
+
+        this->catchUp(subscriber, written);
+
+        if (written - subscriber.cursor < (uint32_t)subscriber.decimation) {
+            return false;
+        }
+
+        struct Sample result = _buffer[(subscriber.cursor + subscriber.decimation - 1) & (capacity - 1)];
+
+        if (subscriber.filter == Filter::average) {
+            float sum = 0.0f;
+
+            for (int i = 0; i < subscriber.decimation; i++) {
+                const struct Sample &sample = _buffer[(subscriber.cursor + i) & (capacity - 1)];
+
+                sum += sample.value;
+                if (sample.status > result.status) {
+                    result.status = sample.status;
+                }
+            }
+
+            result.value = sum / subscriber.decimation;
+        }
+
+        // Producer lapped us while reading: resynchronize and try again. The
+        // fence keeps the buffer reads above from moving past the re-check,
+        // as in a seqlock reader.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_written.load(std::memory_order_relaxed) - subscriber.cursor > (uint32_t)(capacity - 1)) {
+            continue;
+        }
+
+        subscriber.cursor += subscriber.decimation;
+        out = result;
+
+        return true;
+    }
+}
+
+int SampleFanout::available(int id) {
+    return _written.load(std::memory_order_acquire) - _subscribers[id].cursor;
+}
+
+int SampleFanout::getDecimation(int id) {
+    return _subscribers[id].decimation;
+}
+
+uint32_t SampleFanout::getDropped(int id) {
+    return _subscribers[id].dropped;
+}
+
+uint32_t SampleFanout::getPublished() {
+    return _written.load(std::memory_order_relaxed);
+}
+
+} // namespace metromotive
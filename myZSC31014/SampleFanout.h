@@ -0,0 +1,98 @@
+// Copyright 2023 prisma
+
+#ifndef SAMPLEFANOUT_H
+#define SAMPLEFANOUT_H
+
+#include <atomic>
+#include <stdint.h>
+
+// Shared buffer length in samples (must be a power of two)
+#ifndef FANOUT_CAPACITY
+#define FANOUT_CAPACITY 256
+#endif
+
+#ifndef FANOUT_MAX_SUBSCRIBERS
+#define FANOUT_MAX_SUBSCRIBERS 8
+#endif
+
+namespace metromotive {
+
+// Publish/subscribe stage after calibration. The acquisition side writes each
+// sample once into a shared ring buffer; every subscriber reads it at its own
+// rate through its own cursor. publish() never looks at the subscribers, so
+// adding one does not slow acquisition down.
+//
+// Single producer (e.g. a Ticker callback), consumers in thread/main context.
+class SampleFanout {
+public:
+    SampleFanout(float sampleRate); // publish rate, in Hz
+
+    struct Sample {
+        uint32_t timestamp; // us
+        float value;
+        uint8_t status;     // ZSC31014::Status
+    };
+
+    enum class Filter {
+        none,   // every Nth sample
+        average // boxcar over the N samples, worst status, last timestamp
+    };
+
+    enum class DropPolicy {
+        dropOldest,  // on overrun keep as much of the backlog as still exists
+        skipToLatest // on overrun discard the backlog and resume at the newest sample
+    };
+
+    // Zero-copy view into the shared buffer, in two parts when it wraps around
+    struct View {
+        const Sample *first;
+        int firstCount;
+        const Sample *second;
+        int secondCount;
+    };
+
+    // Returns a subscriber id, or -1 if all slots are taken or rate is below
+    // sampleRate / (FANOUT_CAPACITY - 1); decimate further on the consumer side
+    int subscribe(float rate, Filter filter = Filter::average, DropPolicy policy = DropPolicy::dropOldest);
+    void unsubscribe(int id);
+
+    // Acquisition side, O(1)
+    void publish(const struct Sample &sample);
+
+    // Full-rate consumers: borrow up to maxCount samples, then release them.
+    // release() returns false if the producer overwrote part of the view
+    // meanwhile; those samples are counted as dropped.
+    int fetch(int id, struct View &view, int maxCount = FANOUT_CAPACITY);
+    bool release(int id, int count);
+
+    // Decimated consumers: one filtered sample per decimation period
+    bool next(int id, struct Sample &out);
+
+    int available(int id);
+    int getDecimation(int id);
+    uint32_t getDropped(int id);
+    uint32_t getPublished();
+
+private:
+    static const int capacity = FANOUT_CAPACITY;
+
+    struct Subscriber {
+        bool active;
+        int decimation;
+        Filter filter;
+        DropPolicy policy;
+        uint32_t cursor;
+        uint32_t dropped;
+    };
+
+    float _sampleRate;
+    struct Sample _buffer[capacity];
+    std::atomic<uint32_t> _written;
+    struct Subscriber _subscribers[FANOUT_MAX_SUBSCRIBERS];
+
+    void catchUp(struct Subscriber &subscriber, uint32_t written);
+};
+
+} // namespace metromotive
+
+#endif //SAMPLEFANOUT_H
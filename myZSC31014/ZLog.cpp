@@ -0,0 +1,146 @@
+// Copyright 2023 prisma
+
+#include "ZLog.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__MBED__)
+#include "platform/mbed_critical.h"
+#define ZLOG_LOCK() core_util_critical_section_enter()
+#define ZLOG_UNLOCK() core_util_critical_section_exit()
+#else
+#define ZLOG_LOCK()
+#define ZLOG_UNLOCK()
+#endif
+
+namespace metromotive {
+namespace zlog {
+
+static uint8_t buffer[ZLOG_BUFFER_SIZE];
+static int head = 0; // next byte written
+static int tail = 0; // next byte read
+static int used = 0;
+static uint32_t dropped = 0;
+
+Encoder::Encoder(uint32_t token) :
+    length(0)
+{
+    this->putByte(token);
+    this->putByte(token >> 8);
+    this->putByte(token >> 16);
+    this->putByte(token >> 24);
+}
+
+void Encoder::putByte(uint8_t value) {
+    // An overlong record is cut short; the decoder reports missing arguments
+    if (length < ZLOG_MAX_RECORD) {
+        payload[length++] = value;
+    }
+}
+
+void Encoder::putVarint(uint64_t value) {
+    while (value >= 0x80) {
+        this->putByte((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    this->putByte(value);
+}
+
+void Encoder::putSigned(int64_t value) {
+    this->putByte(signedInt);
+    this->putVarint(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+void Encoder::putUnsigned(uint64_t value) {
+    this->putByte(unsignedInt);
+    this->putVarint(value);
+}
+
+void Encoder::putFloat(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    this->putByte(floating);
+    this->putByte(bits);
+    this->putByte(bits >> 8);
+    this->putByte(bits >> 16);
+    this->putByte(bits >> 24);
+}
+
+void Encoder::putString(const char *value) {
+    int stringLength = strlen(value);
+
+    if (stringLength > 32) {
+        stringLength = 32;
+    }
+
+    this->putByte(string);
+    this->putByte(stringLength);
+    for (int i = 0; i < stringLength; i++) {
+        this->putByte(value[i]);
+    }
+}
+
+void commit(const Encoder &encoder) {
+    uint8_t check = 0;
+    for (int i = 0; i < encoder.length; i++) {
+        check ^= encoder.payload[i];
+    }
+
+    int frameLength = encoder.length + 3;
+
+    ZLOG_LOCK();
+
+    if (used + frameLength > ZLOG_BUFFER_SIZE) {
+        dropped++;
+        ZLOG_UNLOCK();
+        return;
+    }
+
+    buffer[head] = frameSync;
+    head = (head + 1) % ZLOG_BUFFER_SIZE;
+    buffer[head] = encoder.length;
+    head = (head + 1) % ZLOG_BUFFER_SIZE;
+    for (int i = 0; i < encoder.length; i++) {
+        buffer[head] = encoder.payload[i];
+        head = (head + 1) % ZLOG_BUFFER_SIZE;
+    }
+    buffer[head] = check;
+    head = (head + 1) % ZLOG_BUFFER_SIZE;
+    used += frameLength;
+
+    ZLOG_UNLOCK();
+}
+
+int read(uint8_t *data, int maxLength) {
+    int count = 0;
+
+    ZLOG_LOCK();
+
+    while (count < maxLength && used > 0) {
+        data[count++] = buffer[tail];
+        tail = (tail + 1) % ZLOG_BUFFER_SIZE;
+        used--;
+    }
+
+    ZLOG_UNLOCK();
+
+    return count;
+}
+
+void flush() {
+    uint8_t chunk[32];
+    int count;
+
+    while ((count = read(chunk, sizeof(chunk))) > 0) {
+        fwrite(chunk, 1, count, stdout);
+    }
+    fflush(stdout);
+}
+
+uint32_t getDropped() {
+    return dropped;
+}
+
+} // namespace zlog
+} // namespace metromotive
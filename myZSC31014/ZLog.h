@@ -0,0 +1,149 @@
+// Copyright 2023 prisma
+
+#ifndef ZLOG_H
+#define ZLOG_H
+
+#include <stdint.h>
+#include <type_traits>
+
+// Tokenized deferred logging.
+//
+// A call site such as ZLOG_ERROR("Unable to read 0x%02x", value) stores only a
+// 32-bit token (FNV-1a hash of the format string, computed at compile time)
+// and the binary arguments in a ring buffer. The format string never reaches
+// flash. zlog::flush() later writes the records to the UART as frames, and
+// tools/zlog_decode.py expands them back into text using the format strings
+// found in the sources. Keep each format string a single literal on the line
+// of the macro, without a trailing newline.
+
+#define ZLOG_LEVEL_NONE  0
+#define ZLOG_LEVEL_ERROR 1
+#define ZLOG_LEVEL_WARN  2
+#define ZLOG_LEVEL_INFO  3
+#define ZLOG_LEVEL_DEBUG 4
+
+// Calls above this level compile to nothing
+#ifndef ZLOG_LEVEL
+#define ZLOG_LEVEL ZLOG_LEVEL_INFO
+#endif
+
+#ifndef ZLOG_BUFFER_SIZE
+#define ZLOG_BUFFER_SIZE 512
+#endif
+
+// Largest record payload: token plus arguments
+#define ZLOG_MAX_RECORD 48
+
+#define ZLOG_TOKEN(fmt) (std::integral_constant<uint32_t, ::metromotive::zlog::hash(fmt)>::value)
+#define ZLOG_WRITE(fmt, ...) ::metromotive::zlog::write(ZLOG_TOKEN(fmt), ##__VA_ARGS__)
+
+#if ZLOG_LEVEL >= ZLOG_LEVEL_ERROR
+#define ZLOG_ERROR(fmt, ...) ZLOG_WRITE(fmt, ##__VA_ARGS__)
+#else
+#define ZLOG_ERROR(fmt, ...) do {} while (0)
+#endif
+
+#if ZLOG_LEVEL >= ZLOG_LEVEL_WARN
+#define ZLOG_WARN(fmt, ...) ZLOG_WRITE(fmt, ##__VA_ARGS__)
+#else
+#define ZLOG_WARN(fmt, ...) do {} while (0)
+#endif
+
+#if ZLOG_LEVEL >= ZLOG_LEVEL_INFO
+#define ZLOG_INFO(fmt, ...) ZLOG_WRITE(fmt, ##__VA_ARGS__)
+#else
+#define ZLOG_INFO(fmt, ...) do {} while (0)
+#endif
+
+#if ZLOG_LEVEL >= ZLOG_LEVEL_DEBUG
+#define ZLOG_DEBUG(fmt, ...) ZLOG_WRITE(fmt, ##__VA_ARGS__)
+#else
+#define ZLOG_DEBUG(fmt, ...) do {} while (0)
+#endif
+
+namespace metromotive {
+namespace zlog {
+
+// Frame on the wire: sync, payload length, payload (token, arguments), xor of payload
+static const uint8_t frameSync = 0xA5;
+
+// Argument type tags, one byte ahead of each argument
+enum ArgType {
+    signedInt = 0,   // zigzag varint
+    unsignedInt = 1, // varint
+    floating = 2,    // float32, little endian
+    string = 3       // length byte, then the characters
+};
+
+constexpr uint32_t hash(const char *s, uint32_t h = 2166136261u) {
+    return *s ? hash(s + 1, (h ^ (uint8_t)*s) * 16777619u) : h;
+}
+
+class Encoder {
+public:
+    Encoder(uint32_t token);
+
+    void putSigned(int64_t value);
+    void putUnsigned(uint64_t value);
+    void putFloat(float value);
+    void putString(const char *value);
+
+    template<typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type put(T value) {
+        this->putSigned(value);
+    }
+
+    template<typename T>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type put(T value) {
+        this->putUnsigned(value);
+    }
+
+    template<typename T>
+    typename std::enable_if<std::is_floating_point<T>::value>::type put(T value) {
+        this->putFloat(value);
+    }
+
+    void put(const char *value) {
+        this->putString(value);
+    }
+
+    uint8_t payload[ZLOG_MAX_RECORD];
+    int length;
+
+private:
+    void putByte(uint8_t value);
+    void putVarint(uint64_t value);
+};
+
+// End of the argument list
+inline void encode(Encoder &) {
+}
+
+template<typename T, typename... Args>
+inline void encode(Encoder &encoder, T value, Args... rest) {
+    encoder.put(value);
+    encode(encoder, rest...);
+}
+
+// Queue a framed record; dropped (and counted) when the buffer is full
+void commit(const Encoder &encoder);
+
+template<typename... Args>
+inline void write(uint32_t token, Args... args) {
+    Encoder encoder(token);
+    encode(encoder, args...);
+    commit(encoder);
+}
+
+// Copy up to maxLength queued bytes out of the buffer, returns the count
+int read(uint8_t *data, int maxLength);
+
+// Write everything queued to stdout. Thread context only: it blocks on the UART.
+void flush();
+
+uint32_t getDropped();
+
+} // namespace zlog
+} // namespace metromotive
+
+#endif //ZLOG_H
@@ -1,36 +1,42 @@
 // Copyright 2021 Metromotive
 
 #include "ZSC31014.h"
-#include "DigitalOut.h"
+#include "CalibrationKernel.h"
+#include "ZLog.h"
 #include <cstdint>
 
 namespace metromotive {
 
 ZSC31014::ZSC31014(I2C &i2c, char address7bit, DigitalOut powerPin) :
-    i2c(i2c),
-    address(address7bit << 1),
-    // address(address7bit),
-    powerPin(powerPin)
+    bus(i2c),
+    core(bus, address7bit, powerPin) // combined reads stay off until probeCombinedReads()
 {
     // i2c.frequency(400000);
-    _calibpoly[0] = 1.00; //gain
-    _calibpoly[1] = 0.00; //offset
-    _bias =0.00;
-
 }
 
-void ZSC31014::startCommandMode() {
-    powerPin.write(0);
+#if defined(__MBED__)
+// Bypasses the scheduler rather than index a client that does not exist
+static int addBusClient(I2CBus &bus, I2CBus::Priority priority) {
+    int client = bus.addClient("ZSC31014", priority);
 
-    wait_us(500);
- 
-    powerPin.write(1);
+    if (client < 0) {
+        ZLOG_WARN("No I2C bus client left, ZSC31014 uses the bus directly.");
+    }
 
-    wait_us(500);
+    return client;
+}
 
-    this->write(StartCommandMode);
+ZSC31014::ZSC31014(I2CBus &bus, char address7bit, DigitalOut powerPin, I2CBus::Priority priority) :
+    bus(bus, addBusClient(bus, priority)),
+    core(this->bus, address7bit, powerPin)
+{
+}
+#endif
 
-    wait_us(100);
+void ZSC31014::startCommandMode() {
+    if (core.startCommandMode() != 0) {
+        ZLOG_ERROR("Unable to write to device. Check i2c address and connections.");
+    }
 }
 
 void ZSC31014::startNormalOperationMode() {
@@ -66,14 +72,7 @@ struct ZSC31014::FactoryID ZSC31014::getFactoryID() {
     uint16_t customerID1 = this->getCustomerID1();
     uint16_t customerID2 = this->getCustomerID2();
 
-    struct FactoryID result;
-
-    result.lotNumber = (customerID2 << 3) | (customerID0 >> 13);
-    result.waferNumber = (customerID0 >> 8) & 0x1F;
-    result.waferXCoordinate = customerID0 & 0x7F;
-    result.waferYCoordinate = customerID1;
-
-    return result;
+    return this->decodeFactoryID(customerID0, customerID1, customerID2);
 }
 
 struct ZSC31014::ZMDIConfig1 ZSC31014::getZMDIConfig1() {
@@ -117,52 +116,86 @@ void ZSC31014::setGain(float gain) {
 }
 
 void ZSC31014::dumpEEPROM() {
-    printf("EEPROM Values\n");
+    ZLOG_INFO("EEPROM Values");
     for (int i = 0; i <= 0x13; i ++) {
         int value = this->read((Command)i);
-        printf("0x%02x: 0x%04x\n", i, value);
+        ZLOG_INFO("0x%02x: 0x%04x", i, value);
         wait_us(10);
     }
 }
 
-void ZSC31014::powerCycle() {
-    powerPin.write(0);
+void ZSC31014::setCombinedReads(bool combined) {
+    core.setCombinedReads(combined);
+}
 
-    wait_us(500);
+bool ZSC31014::probeCombinedReads() {
+    bool combined = core.probeCombinedReads();
+
+    ZLOG_INFO("Combined register reads %s", combined ? "on" : "off");
+    return combined;
+}
 
-    powerPin.write(1);
+int ZSC31014::negotiateBusSpeed(int maxHz) {
+    int hz = core.negotiateBusSpeed(maxHz);
 
-    wait_us(500);
+    if (hz < 0) {
+        ZLOG_WARN("Bus speed not negotiated: clock set elsewhere or not verified at any speed");
+    } else {
+        ZLOG_INFO("I2C at %d Hz", hz);
+    }
+
+    return hz;
 }
 
-uint16_t ZSC31014::read(Command command) {
-    this->write(command);
+bool ZSC31014::sharesBus(ZSC31014 &other) {
+    if (bus.isScheduled() || other.bus.isScheduled()) {
+        return false; // I2CBus transactions always end with a stop
+    }
 
-    wait_us(100);
+    return &bus.getI2C() == &other.bus.getI2C();
+}
 
-    char readPacket[3] = {0x00, 0x00, 0x00};
+void ZSC31014::powerCycle() {
+    core.powerCycle();
+}
 
-    if (this->i2c.read(address, readPacket, 3) != 0) {
-        printf("Unable to read from device. Check i2c address and connections.\n");
-        return -1;
-    } else if (readPacket[0] != 0x5A) {
-        printf("Invalid response byte from device. Maybe not in command mode? "
-               "(bytes are %2x %2x %2x).\n",
-               readPacket[0], readPacket[1], readPacket[2]);
-        return -1;
-    } else {
-        return (readPacket[1] << 8) | readPacket[2];
+void ZSC31014::powerUp() {
+    core.powerUp();
+}
+
+void ZSC31014::powerDown() {
+    core.powerDown();
+}
+
+uint16_t ZSC31014::read(Command command) {
+    uint16_t value;
+
+    if (!core.readRegister(command, value)) {
+        ZLOG_ERROR("Unable to read register 0x%02x. Check i2c address and connections, and that the device is in command mode.",
+                   (uint8_t)command);
+        return 0xFFFF;
     }
+
+    return value;
 }
 
 void ZSC31014::write(Command command, uint16_t value) {
-    char packet[3] = { command, (char)(value >> 8), (char)(value & 0xFF) };
-
-    if (this->i2c.write(address, packet, 3) != 0) {
-        printf("Unable to write to device. Check i2c address and connections.\n");
+    if (core.command(command, value) != 0) {
+        ZLOG_ERROR("Unable to write to device. Check i2c address and connections.");
     }
 }
 
+struct ZSC31014::FactoryID ZSC31014::decodeFactoryID(uint16_t customerID0, uint16_t customerID1, uint16_t customerID2) {
+    struct FactoryID result;
+
+    result.lotNumber = (customerID2 << 3) | (customerID0 >> 13);
+    result.waferNumber = (customerID0 >> 8) & 0x1F;
+    result.waferXCoordinate = customerID0 & 0x7F;
+    result.waferYCoordinate = customerID1;
+
+    return result;
+}
+
 struct ZSC31014::ZMDIConfig1 ZSC31014::decodeZMDIConfig1(uint16_t rawValue) {
     struct ZMDIConfig1 result;
 
@@ -265,7 +298,7 @@ struct ZSC31014::BridgeConfig ZSC31014::decodeBridgeConfig(uint16_t rawValue) {
             break;
         
         default:
-            printf("ERROR: Invalid Mux Mode read from bridge config!\n");
+            ZLOG_ERROR("ERROR: Invalid Mux Mode read from bridge config!");
             break;
     }
 
@@ -281,7 +314,7 @@ uint16_t ZSC31014::encodeZMDIConfig1(struct ZMDIConfig1 zmdiConfig1) {
     int clockSpeedBit = (zmdiConfig1.clockSpeed == ClockSpeed::mhz1) ? 0b1 : 0b0;
     int commTypeBit = (zmdiConfig1.commType == CommType::spi) ? 0b1 : 0b0;
     int sleepModeBit = (zmdiConfig1.sleepMode == OperationMode::onDemand) ? 0b1 : 0b0;
-    int updateRateBits;
+    int updateRateBits = 0b00;
 
     switch (zmdiConfig1.updateRate) {
         case UpdateRate::slowest:
@@ -350,7 +383,7 @@ uint16_t ZSC31014::encodeZMDIConfig2(struct ZMDIConfig2 zmdiConfig2) {
 uint16_t ZSC31014::encodeBridgeConfig(struct BridgeConfig bridgeConfig) {
     uint16_t result = 0x0000;
 
-    int preAmpGainBits;
+    int preAmpGainBits = 0b000;
 
     switch (bridgeConfig.preAmpGain) {
         case PreAmpGain::x1_5:
@@ -420,7 +453,7 @@ uint16_t ZSC31014::encodeGain(float gain) {
     uint16_t encodedGain = 0x0000;
 
     if (gain >= 32) {
-        printf("Gain out of range");
+        ZLOG_ERROR("Gain out of range");
         return 0;
     } else if (gain >= 4) {
         gain /= 8;
@@ -436,8 +469,8 @@ uint16_t ZSC31014::encodeGain(float gain) {
 // custom 
 
 void ZSC31014::setup(char new_address, PreAmpGain gain , bool verbose ) {
-    if(verbose) printf("\n****\nSTART CALIB\n****\n");
-    if(verbose) printf("\nNew Address = 0x%3x \n",new_address);
+    if(verbose) ZLOG_INFO("START CALIB");
+    if(verbose) ZLOG_INFO("New Address = 0x%3x", new_address);
 
 
     thread_sleep_for(150);
@@ -445,18 +478,18 @@ void ZSC31014::setup(char new_address, PreAmpGain gain , bool verbose ) {
 
     thread_sleep_for(150);
 
-    unsigned int customerID0 = this->getCustomerID0();
-    unsigned int customerID1 = this->getCustomerID1();
-    unsigned int customerID2 = this->getCustomerID2();
+    this->getCustomerID0();
+    this->getCustomerID1();
+    this->getCustomerID2();
 
     struct ZSC31014::FactoryID factoryID = this->getFactoryID();
 
-    printf( "Factory ID:\nLot # %d\nWafer # %d\nCoordinate (x/y): %d/%d,\nI2C Address: 0x%x\n",
+    ZLOG_INFO("Factory ID: Lot # %d, Wafer # %d, Coordinate (x/y): %d/%d, I2C Address: 0x%x",
        factoryID.lotNumber,
        factoryID.waferNumber,
        factoryID.waferXCoordinate, 
        factoryID.waferYCoordinate,
-       address
+       (uint8_t)core.getAddress()
     );
 
     struct ZSC31014::ZMDIConfig1 zmdiConfig1 = this->getZMDIConfig1();
@@ -465,7 +498,7 @@ void ZSC31014::setup(char new_address, PreAmpGain gain , bool verbose ) {
 
     this->setZMDIConfig1(zmdiConfig1);
 
-    if(verbose) printf("set setZMDIConfig1\n");
+    if(verbose) ZLOG_INFO("set setZMDIConfig1");
     thread_sleep_for(150);
 
     struct ZSC31014::ZMDIConfig2 zmdiConfig2 = this->getZMDIConfig2();
@@ -478,7 +511,7 @@ void ZSC31014::setup(char new_address, PreAmpGain gain , bool verbose ) {
 
     this->setZMDIConfig2(zmdiConfig2);
 
-    if(verbose) printf("set setZMDIConfig2\n");
+    if(verbose) ZLOG_INFO("set setZMDIConfig2");
     thread_sleep_for(150);
 
     struct ZSC31014::BridgeConfig bridgeConfig = this->getBridgeConfig();
@@ -492,67 +525,136 @@ void ZSC31014::setup(char new_address, PreAmpGain gain , bool verbose ) {
 
     this->setBridgeConfig(bridgeConfig);
 
-    if(verbose) printf("set bridgeconf\n");
+    if(verbose) ZLOG_INFO("set bridgeconf");
     thread_sleep_for(150);
 
     // DYMH.setOffset(0xE400);
     this->setOffset(0xE000);
-    if(verbose) printf("set Offset\n");
+    if(verbose) ZLOG_INFO("set Offset");
     thread_sleep_for(150);
 
-    if(verbose) printf("Actual offset %d \n",this->getOffset());
-    if(verbose) printf("Actual gain %f \n",this->getGain());
+    if(verbose) ZLOG_INFO("Actual offset %d", this->getOffset());
+    if(verbose) ZLOG_INFO("Actual gain %f", this->getGain());
     thread_sleep_for(150);
 
     this->startNormalOperationMode();
 
-    if(verbose) printf("set normal operations\n");
+    if(verbose) ZLOG_INFO("set normal operations");
     thread_sleep_for(150);
 
-    if(verbose) printf("Wrote basic configuration and started normal operation mode.\n");
-    address = new_address;
-    if(verbose) printf("updated i2c address\n");
+    if(verbose) ZLOG_INFO("Wrote basic configuration and started normal operation mode.");
+    core.setAddress(new_address);
+    if(verbose) ZLOG_INFO("updated i2c address");
 
 
 }
 
 
 uint16_t ZSC31014::read_raw(void){
-        uint16_t raw =0;
-        this->i2c.read(address << 1, readbuff, 2);
-        raw = (readbuff[0] & 0b00111111)<<8;
-        raw |= readbuff[1];
-        return raw;
+        return core.read_raw();
+}
+
+uint16_t ZSC31014::read_raw_word(bool repeated){
+        return core.read_raw_word(repeated);
+}
+
+bool ZSC31014::read_raw_word(uint16_t &word, bool repeated){
+        return core.read_raw_word(word, repeated);
+}
+
+void ZSC31014::attachHealthMonitor(HealthMonitor *monitor) {
+    core.attachHealthMonitor(monitor);
+}
+
+bool ZSC31014::serviceHealth() {
+    return core.serviceHealth();
 }
 
 void ZSC31014::set_linear_calib(float gain, float offset){
-    _calibpoly[0] = gain; // v = p0*r +p1 -bias
-    _calibpoly[1] = offset;
+    core.set_linear_calib(gain, offset); // v = p0*r +p1 -bias
+}
+
+void ZSC31014::get_linear_calib(float &gain, float &offset){
+    core.get_linear_calib(gain, offset);
+}
+
+void ZSC31014::set_bias(float bias){
+    core.set_bias(bias);
+}
+
+float ZSC31014::get_bias(void){
+    return core.get_bias();
 }
 
 float ZSC31014::read_corrected(void){
-    return _calibpoly[0]*this->read_raw() +_calibpoly[1] - _bias;
+    return core.read_corrected();
+}
+
+void ZSC31014::correct_block(const uint16_t *words, int n, float *out, uint8_t *status){
+    // Calibration is read once per block instead of once per sample
+    core.correct_block(words, n, out, status);
+}
+
+#if !defined(__MBED__)
+int ZSC31014::read_raw_word_batch(ZSC31014 *const *sensors, int count, uint16_t *words) {
+    char addresses[ZSC31014_BATCH_MAX];
+    char data[2 * ZSC31014_BATCH_MAX];
+    int result = 0;
+
+    if (count <= 0 || count > ZSC31014_BATCH_MAX) {
+        ZLOG_ERROR("Batch read of %d sensors, at most %d.", count, ZSC31014_BATCH_MAX);
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (&sensors[i]->bus.getI2C() != &sensors[0]->bus.getI2C()) {
+            ZLOG_ERROR("Batch read across different I2C adapters.");
+            return -1;
+        }
+        addresses[i] = sensors[i]->core.getAddress() << 1;
+    }
+
+    if (sensors[0]->bus.getI2C().readMany(addresses, data, 2, count) != 0) {
+        // One NACK fails the whole transfer: read each sensor on its own so
+        // only the one that does not answer is charged with the bus error
+        for (int i = 0; i < count; i++) {
+            if (!sensors[i]->read_raw_word(words[i])) {
+                result = -1;
+            }
+        }
+        return result;
+    }
+
+    for (int i = 0; i < count; i++) {
+        words[i] = ((uint8_t)data[2 * i] << 8) | (uint8_t)data[2 * i + 1];
+        sensors[i]->core.checkHealth(words[i], true);
+    }
+
+    return 0;
 }
+#endif
 
 float ZSC31014::reset_bias(int Nmeas, bool verbose){
     double sum_d =0.00;
     int sum_i =0;
     uint16_t r =0;
+    float gain, offset;
+    core.get_linear_calib(gain, offset);
     for(int i =0; i<Nmeas;i++){
         r = this->read_raw();
         sum_i+= r;
-        sum_d+=  _calibpoly[0]*r +_calibpoly[1];
+        sum_d+=  gain*r +offset;
         thread_sleep_for(100);
     }
 
-    if(verbose) printf("sum_d %f , sum_i %d\n", sum_d, sum_i);
+    if(verbose) ZLOG_INFO("sum_d %f , sum_i %d", sum_d, sum_i);
 
     sum_d = sum_d/double(Nmeas);
     sum_i = sum_i/Nmeas;
-    if(verbose) printf("mean_d %f , mean_i %d\n", sum_d, sum_i);
+    if(verbose) ZLOG_INFO("mean_d %f , mean_i %d", sum_d, sum_i);
 
-    _bias = float(sum_d);
-    return _bias;
+    core.set_bias(float(sum_d));
+    return float(sum_d);
 }
 
 
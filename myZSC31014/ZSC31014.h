@@ -3,15 +3,33 @@
 #ifndef ZSC31014_H
 #define ZSC31014_H
 
+#if defined(__MBED__)
 #include "DigitalOut.h"
 #include "mbed.h"
+#include "I2CBus.h"
+#else
+#include "LinuxPlatform.h"
+#endif
+#include "HealthMonitor.h"
+#include "ZSC31014Core.h"
+#include "ZSC31014Policies.h"
 #include <stdint.h>
 
+// Sensors per read_raw_word_batch() call
+#ifndef ZSC31014_BATCH_MAX
+#define ZSC31014_BATCH_MAX 16
+#endif
+
 namespace metromotive {
 
 class ZSC31014 {
 public:
     ZSC31014(I2C &i2c, char address7bit, DigitalOut powerPin);
+#if defined(__MBED__)
+    // Shares the bus with other drivers through the scheduler
+    ZSC31014(I2CBus &bus, char address7bit, DigitalOut powerPin,
+             I2CBus::Priority priority = I2CBus::Priority::realtime);
+#endif
 
     enum class ClockSpeed {
         mhz4 = 0,
@@ -50,6 +68,13 @@ public:
         halfBridge = 0b11
     };
 
+    enum class Status { // bits 15:14 of every output word
+        valid = 0b00,
+        commandMode = 0b01,
+        stale = 0b10,
+        diagnostic = 0b11
+    };
+
     enum class PreAmpGain {
         x1_5 = 0b000,
         x3   = 0b100,
@@ -148,7 +173,12 @@ public:
     void setSecondOrderTerm(int sot);
     
     void dumpEEPROM();
+    void setCombinedReads(bool combined); // command and response in one repeated-start transfer
+    bool probeCombinedReads(); // in command mode: turn combined reads on if the chip keeps up
+    int negotiateBusSpeed(int maxHz = zsc31014RatedHz); // in normal operation: fastest clock matching a 100 kHz reference, 400 kHz unless 1000000 is passed; -1 if none, on an I2CBus or on Linux
     void powerCycle();
+    void powerUp();
+    void powerDown();
 
     // Danger Zone
     bool isEEPROMLocked();
@@ -158,24 +188,42 @@ public:
 
     void setup(char new_address, PreAmpGain gain = PreAmpGain::x192, bool verbose = false); // call just one time to save in eeprom
     uint16_t read_raw(void); 
+    uint16_t read_raw_word(bool repeated = false); // raw reading with the status bits; repeated: no stop, see sharesBus()
+    bool read_raw_word(uint16_t &word, bool repeated = false); // false if the device did not acknowledge
+    bool sharesBus(ZSC31014 &other); // same I2C object, so reads can be chained with repeated starts
     void set_linear_calib(float gain, float offset); // v = p0*r +p1 -bias
+    void get_linear_calib(float &gain, float &offset);
+    void set_bias(float bias); // restore a previous reset_bias() result
+    float get_bias(void);
     float read_corrected(void);
+    void correct_block(const uint16_t *words, int n, float *out, uint8_t *status); // words from read_raw_word(); offset - bias is folded first, so results may differ from read_corrected() in the last bit
     float reset_bias(int Nmeas = 20, bool verbose = false);
+    void attachHealthMonitor(HealthMonitor *monitor); // fed from read_raw_word()
+    bool serviceHealth(); // power cycles the sensor if the monitor asks for it; between reads, true if it did
+#if !defined(__MBED__)
+    // One I2C_RDWR for up to ZSC31014_BATCH_MAX sensors on the same LinuxI2C.
+    // If it fails, each sensor is read on its own; -1 if any did not answer
+    static int read_raw_word_batch(ZSC31014 *const *sensors, int count, uint16_t *words);
+#endif
         
 
 
 private:
-    I2C &i2c;
-    char address; // Stored as 8-bit address with lsb set to 0
-    DigitalOut powerPin;
+    friend class Provisioner; // programs raw EEPROM words on many chips
 
-    char readbuff[2]; //custom
+#if defined(__MBED__)
+    typedef ZSC31014Core<ZSC31014Bus, MbedDelay, DigitalOut> Core;
+#else
+    typedef ZSC31014Core<ZSC31014Bus, LinuxDelay, DigitalOut> Core;
+#endif
 
-    float _calibpoly[2]; // v = p0*r +p1 -bias
-    float _bias;
+    ZSC31014Bus bus; // I2C object or I2CBus client
+    Core core;       // sample path, command mode, power and calibration; refers to bus
+
+    // core keeps a reference to bus
+    ZSC31014(const ZSC31014 &);
+    ZSC31014 &operator=(const ZSC31014 &);
 
-    
-    
     enum Command {
         ReadCust_ID0 = 0x00,
         ReadZMDI_Config1,
@@ -228,6 +276,7 @@ private:
     struct ZMDIConfig1 decodeZMDIConfig1(uint16_t rawValue);
     struct ZMDIConfig2 decodeZMDIConfig2(uint16_t rawValue);
     struct BridgeConfig decodeBridgeConfig(uint16_t rawValue);
+    struct FactoryID decodeFactoryID(uint16_t customerID0, uint16_t customerID1, uint16_t customerID2);
 
     uint16_t encodeZMDIConfig1(struct ZMDIConfig1 zmdiConfig1);
     uint16_t encodeZMDIConfig2(struct ZMDIConfig2 zmdiConfig2);
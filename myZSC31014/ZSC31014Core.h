@@ -0,0 +1,360 @@
+// Copyright 2023 prisma
+
+#ifndef ZSC31014CORE_H
+#define ZSC31014CORE_H
+
+#include "CalibrationKernel.h"
+#include "HealthMonitor.h"
+#include "ZLog.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Reads checked at each clock by negotiateBusSpeed()
+#ifndef ZSC31014_VERIFY_READS
+#define ZSC31014_VERIFY_READS 16
+#endif
+
+// Counts a word may lie beyond the spread of the 100 kHz reference burst
+#ifndef ZSC31014_VERIFY_MARGIN
+#define ZSC31014_VERIFY_MARGIN 16
+#endif
+
+namespace metromotive {
+
+// Standard, Fast-mode and Fast-mode Plus, tried fastest first
+static const int zsc31014BusSpeeds[] = { 1000000, 400000, 100000 };
+
+// The datasheet rates the ZSC31014 I2C interface up to 400 kHz; Fast-mode
+// Plus is beyond the rating and only tried on request
+static const int zsc31014RatedHz = 400000;
+
+// Sets the bus clock; false where the clock is not the driver's to set. Bus
+// types with a fixed or shared clock overload this (LinuxI2C, ZSC31014Bus).
+template <class Bus>
+inline bool setBusFrequency(Bus &bus, int hz) {
+    bus.frequency(hz);
+    return true;
+}
+
+// Normal-mode words read back to back: all acknowledged, no diagnostic or
+// command-mode status, a stale word repeats the data of the word before it
+// and the data lies within low..high. A bit error from slow edges can leave a
+// valid status and consistent stale words; taking the band from a reference
+// burst at 100 kHz catches it in the data.
+inline bool verifyBusReads(const uint16_t *words, const int *results, int count,
+                           uint16_t low = 0, uint16_t high = 0x3FFF) {
+    for (int i = 0; i < count; i++) {
+        uint16_t status = words[i] >> 14;
+        uint16_t data = words[i] & 0x3FFF;
+
+        if (results[i] != 0 || status == 0b01 || status == 0b11) {
+            return false;
+        }
+
+        if (data < low || data > high) {
+            return false;
+        }
+
+        if (i > 0 && status == 0b10 && (words[i] & 0x3FFF) != (words[i - 1] & 0x3FFF)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Bus access of the ZSC31014 as a template, for builds where the bus, the
+// clock and the power pin are known at compile time. Everything is inline and
+// the policies are called directly, so read_raw() ends up as the bus read and
+// a few shifts. This is the sample path and command mode on any bus; the
+// ZSC31014 class runs on top of it (over ZSC31014Bus) and adds the EEPROM
+// configuration.
+//
+// Bus:   int read(int address, char *data, int length, bool repeated = false);
+//        int write(int address, const char *data, int length, bool repeated = false);
+//        with 8-bit addresses and 0 on success (mbed I2C, LinuxI2C, SimI2C)
+// Delay: static void us(uint32_t us); static void ms(uint32_t ms);
+// Power: void write(int value); (DigitalOut, SimPower)
+//
+// Ready-made combinations are in ZSC31014Policies.h and ZSC31014Sim.h.
+template <class Bus, class Delay, class Power>
+class ZSC31014Core {
+public:
+    ZSC31014Core(Bus &bus, char address7bit, Power power) :
+        _bus(bus),
+        _power(power),
+        _address(address7bit << 1),
+        _combinedReads(false),
+        _health(NULL),
+        _gain(1.0f),
+        _offset(0.0f),
+        _bias(0.0f)
+    {
+    }
+
+    // Normal operation mode. repeated: no stop, the next read on the same bus
+    // starts with a repeated start
+    uint16_t read_raw_word(bool repeated = false) {
+        uint16_t word;
+        this->read_raw_word(word, repeated);
+        return word;
+    }
+
+    // false if the device did not acknowledge
+    bool read_raw_word(uint16_t &word, bool repeated = false) {
+        char data[2] = {0x00, 0x00};
+        int result = _bus.read(_address, data, 2, repeated);
+
+        word = ((uint8_t)data[0] << 8) | (uint8_t)data[1];
+        if (_health != NULL) {
+            this->checkHealth(word, result == 0);
+        }
+
+        return result == 0;
+    }
+
+    // Feeds the health monitor, for words read outside read_raw_word(). Only
+    // marks a recovery as due, the read may be part of a repeated-start chain
+    void checkHealth(uint16_t word, bool ok) {
+        if (_health != NULL) {
+            _health->feed(word, ok);
+        }
+    }
+
+    // Power cycles the sensor when the health monitor asks for it. Call it
+    // between reads, not inside a chain; true if it did
+    bool serviceHealth() {
+        if (_health == NULL || !_health->isRecoveryDue()) {
+            return false;
+        }
+
+        ZLOG_WARN("Power cycling sensor at 0x%02x", (uint8_t)this->getAddress());
+        this->powerCycle();
+        _health->recoveryStarted();
+
+        return true;
+    }
+
+    uint16_t read_raw() {
+        return this->read_raw_word() & 0x3FFF;
+    }
+
+    float read_corrected() {
+        return _gain * this->read_raw() + _offset - _bias; // v = p0*r +p1 -bias
+    }
+
+    // Same conversion as ZSC31014::correct_block()
+    void correct_block(const uint16_t *words, int n, float *out, uint8_t *status) {
+        calibrateBlock(words, n, _gain, _offset - _bias, out, status);
+    }
+
+    void set_linear_calib(float gain, float offset) {
+        _gain = gain;
+        _offset = offset;
+    }
+
+    void get_linear_calib(float &gain, float &offset) {
+        gain = _gain;
+        offset = _offset;
+    }
+
+    void set_bias(float bias) {
+        _bias = bias;
+    }
+
+    float get_bias() {
+        return _bias;
+    }
+
+    void attachHealthMonitor(HealthMonitor *monitor) {
+        _health = monitor;
+    }
+
+    // Command mode: power cycle, then the start command inside the command
+    // window. 0 on success, like command()
+    int startCommandMode() {
+        this->powerCycle();
+        int result = this->command(0xA0);
+        Delay::us(100);
+        return result;
+    }
+
+    int startNormalOperationMode() {
+        return this->command(0x80);
+    }
+
+    // Read command 0x00-0x13: EEPROM word; 0xFFFF if the device does not answer
+    uint16_t readRegister(uint8_t command) {
+        uint16_t value;
+        return this->readRegister(command, value) ? value : 0xFFFF;
+    }
+
+    // false if the device did not answer or the response is not marked 0x5A
+    bool readRegister(uint8_t command, uint16_t &value) {
+        // Response not ready without the 100us gap: fall back to separate transfers
+        if (_combinedReads && this->readRegisterCombined(command, value)) {
+            return true;
+        }
+
+        char packet[3] = { (char)command, 0x00, 0x00 };
+        char response[3] = { 0x00, 0x00, 0x00 };
+
+        if (_bus.write(_address, packet, 3) != 0) {
+            return false;
+        }
+
+        Delay::us(100);
+
+        if (_bus.read(_address, response, 3) != 0 || response[0] != 0x5A) {
+            return false;
+        }
+
+        value = ((uint8_t)response[1] << 8) | (uint8_t)response[2];
+        return true;
+    }
+
+    int command(uint8_t command, uint16_t value = 0) {
+        char packet[3] = { (char)command, (char)(value >> 8), (char)(value & 0xFF) };
+
+        return _bus.write(_address, packet, 3);
+    }
+
+    void setCombinedReads(bool combined) {
+        _combinedReads = combined;
+    }
+
+    // In command mode: enables combined reads if the chip answers them with
+    // the new response rather than the previous one
+    bool probeCombinedReads() {
+        uint16_t first;
+        uint16_t second;
+        uint16_t combined;
+
+        _combinedReads = false;
+        if (!this->readRegister(0x00, first) ||   // Cust_ID0
+            !this->readRegister(0x01, second)) {  // ZMDI_Config1, response left pending
+            return false;
+        }
+
+        // A chip that is not ready would hand back the pending response
+        _combinedReads = (first != second) && this->readRegisterCombined(0x00, combined) && combined == first;
+
+        return _combinedReads;
+    }
+
+    // In normal operation mode, with the load still: highest clock up to maxHz
+    // at which a burst of reads agrees with a reference burst taken at 100 kHz.
+    // maxHz defaults to the rated clock; pass 1000000 to try Fast-mode Plus.
+    // Returns the clock, or -1: none verified (left at 100 kHz), or the clock
+    // cannot be set from here (see setBusFrequency()) and was left alone.
+    int negotiateBusSpeed(int maxHz = zsc31014RatedHz) {
+        uint16_t words[ZSC31014_VERIFY_READS];
+        int results[ZSC31014_VERIFY_READS];
+
+        if (!setBusFrequency(_bus, 100000)) {
+            return -1;
+        }
+
+        this->readBurst(words, results);
+        if (!verifyBusReads(words, results, ZSC31014_VERIFY_READS)) {
+            return -1;
+        }
+
+        // Band of the reference data, widened by its own spread and the margin
+        uint16_t low = 0x3FFF;
+        uint16_t high = 0;
+        for (int i = 0; i < ZSC31014_VERIFY_READS; i++) {
+            uint16_t data = words[i] & 0x3FFF;
+            low = data < low ? data : low;
+            high = data > high ? data : high;
+        }
+        int margin = (high - low) + ZSC31014_VERIFY_MARGIN;
+        low = low > margin ? low - margin : 0;
+        high = high + margin < 0x3FFF ? high + margin : 0x3FFF;
+
+        for (unsigned int s = 0; s < sizeof(zsc31014BusSpeeds) / sizeof(zsc31014BusSpeeds[0]); s++) {
+            int hz = zsc31014BusSpeeds[s];
+            if (hz > maxHz) {
+                continue;
+            }
+
+            setBusFrequency(_bus, hz);
+            if (hz == 100000) {
+                return hz; // the reference itself
+            }
+
+            this->readBurst(words, results);
+            if (verifyBusReads(words, results, ZSC31014_VERIFY_READS, low, high)) {
+                return hz;
+            }
+        }
+
+        setBusFrequency(_bus, 100000);
+        return -1;
+    }
+
+    void powerCycle() {
+        _power.write(0);
+        Delay::us(500);
+        _power.write(1);
+        Delay::us(500);
+    }
+
+    void powerUp() {
+        _power.write(1);
+    }
+
+    void powerDown() {
+        _power.write(0);
+    }
+
+    Bus &getBus() {
+        return _bus;
+    }
+
+    char getAddress() {
+        return (uint8_t)_address >> 1;
+    }
+
+    // After the chip was given a new address in ZMDI_Config2 and restarted
+    void setAddress(char address7bit) {
+        _address = address7bit << 1;
+    }
+
+private:
+    Bus &_bus;
+    Power _power;
+    char _address; // 8-bit, lsb 0
+    bool _combinedReads;
+    HealthMonitor *_health;
+
+    float _gain;
+    float _offset;
+    float _bias;
+
+    // Command and response read with a repeated start, no gap
+    void readBurst(uint16_t *words, int *results) {
+        for (int i = 0; i < ZSC31014_VERIFY_READS; i++) {
+            char data[2] = {0x00, 0x00};
+            results[i] = _bus.read(_address, data, 2);
+            words[i] = ((uint8_t)data[0] << 8) | (uint8_t)data[1];
+        }
+    }
+
+    bool readRegisterCombined(uint8_t command, uint16_t &value) {
+        char packet[3] = { (char)command, 0x00, 0x00 };
+        char response[3] = { 0x00, 0x00, 0x00 };
+
+        if (_bus.write(_address, packet, 3, true) != 0 ||
+            _bus.read(_address, response, 3) != 0 || response[0] != 0x5A) {
+            return false;
+        }
+
+        value = ((uint8_t)response[1] << 8) | (uint8_t)response[2];
+        return true;
+    }
+};
+
+} // namespace metromotive
+
+#endif //ZSC31014CORE_H
@@ -0,0 +1,161 @@
+// Copyright 2023 prisma
+
+#ifndef ZSC31014POLICIES_H
+#define ZSC31014POLICIES_H
+
+#include "ZSC31014Core.h"
+
+#if defined(__MBED__)
+#include "mbed.h"
+#include "I2CBus.h"
+#else
+#include "LinuxPlatform.h"
+#endif
+#include <string.h>
+
+// Longest write ZSC31014Bus holds back for a following repeated-start read
+#define ZSC31014BUS_PENDING_MAX 4
+
+namespace metromotive {
+
+// Bus policy of the ZSC31014 class: the I2C object itself, or a client of the
+// I2CBus scheduler when other drivers share the bus. The scheduler ends every
+// transaction with a stop, so there a repeated-start write is held back and
+// sent with the next read from the same address as one transaction.
+class ZSC31014Bus {
+public:
+    ZSC31014Bus(I2C &i2c) :
+        _i2c(i2c)
+#if defined(__MBED__)
+        ,
+        _bus(NULL),
+        _client(-1),
+        _pendingAddress(-1),
+        _pendingLength(0)
+#endif
+    {
+    }
+
+#if defined(__MBED__)
+    // client < 0: no scheduler slot, use the I2C object directly
+    ZSC31014Bus(I2CBus &bus, int client) :
+        _i2c(bus.getI2C()),
+        _bus(client >= 0 ? &bus : NULL),
+        _client(client),
+        _pendingAddress(-1),
+        _pendingLength(0)
+    {
+    }
+#endif
+
+    int read(int address, char *data, int length, bool repeated = false) {
+#if defined(__MBED__)
+        if (_bus != NULL) {
+            if (_pendingAddress == address) {
+                _pendingAddress = -1;
+                return _bus->transfer(_client, address, _pending, _pendingLength, data, length, true);
+            }
+            if (this->flushPending() != 0) {
+                return -1;
+            }
+            return _bus->read(_client, address, data, length);
+        }
+#endif
+
+        return _i2c.read(address, data, length, repeated);
+    }
+
+    int write(int address, const char *data, int length, bool repeated = false) {
+#if defined(__MBED__)
+        if (_bus != NULL) {
+            if (this->flushPending() != 0) {
+                return -1;
+            }
+            if (repeated && length <= ZSC31014BUS_PENDING_MAX) {
+                memcpy(_pending, data, length);
+                _pendingLength = length;
+                _pendingAddress = address;
+                return 0;
+            }
+            return _bus->write(_client, address, data, length);
+        }
+#endif
+
+        return _i2c.write(address, data, length, repeated);
+    }
+
+    // false on a scheduled bus: the other peripherals were not checked at
+    // the new clock. Otherwise as setBusFrequency() for the I2C object
+    bool setFrequency(int hz) {
+        if (this->isScheduled()) {
+            return false;
+        }
+
+        return setBusFrequency(_i2c, hz);
+    }
+
+    I2C &getI2C() {
+        return _i2c;
+    }
+
+    // Through the scheduler: no repeated start across transactions
+    bool isScheduled() {
+#if defined(__MBED__)
+        return _bus != NULL;
+#else
+        return false;
+#endif
+    }
+
+private:
+    I2C &_i2c;
+#if defined(__MBED__)
+    I2CBus *_bus;
+    int _client;
+
+    int _pendingAddress;
+    char _pending[ZSC31014BUS_PENDING_MAX];
+    int _pendingLength;
+
+    int flushPending() {
+        if (_pendingAddress < 0) {
+            return 0;
+        }
+
+        int address = _pendingAddress;
+        _pendingAddress = -1;
+
+        return _bus->write(_client, address, _pending, _pendingLength);
+    }
+#endif
+};
+
+inline bool setBusFrequency(ZSC31014Bus &bus, int hz) {
+    return bus.setFrequency(hz);
+}
+
+#if defined(__MBED__)
+
+struct MbedDelay {
+    static void us(uint32_t us) { wait_us(us); }
+    static void ms(uint32_t ms) { thread_sleep_for(ms); }
+};
+
+// mbed I2C and DigitalOut already have the Bus and Power interfaces
+typedef ZSC31014Core<I2C, MbedDelay, DigitalOut> ZSC31014Mbed;
+
+#else
+
+struct LinuxDelay {
+    static void us(uint32_t us) { wait_us(us); }
+    static void ms(uint32_t ms) { thread_sleep_for(ms); }
+};
+
+// /dev/i2c-N and a sysfs GPIO for the power pin
+typedef ZSC31014Core<LinuxI2C, LinuxDelay, DigitalOut> ZSC31014Linux;
+
+#endif
+
+} // namespace metromotive
+
+#endif //ZSC31014POLICIES_H
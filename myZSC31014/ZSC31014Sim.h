@@ -0,0 +1,342 @@
+// Copyright 2023 prisma
+
+#ifndef ZSC31014SIM_H
+#define ZSC31014SIM_H
+
+#include "ZSC31014Core.h"
+#include <stdint.h>
+#include <string.h>
+
+// Power-on to end of the command window
+#ifndef ZSC31014SIM_COMMAND_WINDOW_US
+#define ZSC31014SIM_COMMAND_WINDOW_US 3000
+#endif
+
+#define ZSC31014SIM_MAX_DEVICES 8
+
+namespace metromotive {
+
+// Simulated time, advanced by SimDelay and by every transfer on a SimI2C
+class SimClock {
+public:
+    static uint64_t nowNs() { return time(); }
+    static void advanceNs(uint64_t ns) { time() += ns; }
+    static void reset() { time() = 0; }
+
+private:
+    static uint64_t &time() {
+        static uint64_t ns = 0;
+        return ns;
+    }
+};
+
+struct SimDelay {
+    static void us(uint32_t us) { SimClock::advanceNs((uint64_t)us * 1000); }
+    static void ms(uint32_t ms) { SimClock::advanceNs((uint64_t)ms * 1000000); }
+};
+
+// Timer interface on SimClock, for code that measures time with an mbed Timer
+class SimTimer {
+public:
+    void start() {}
+    int read_us() { return (int)(SimClock::nowNs() / 1000); }
+};
+
+// The chip as seen from the bus: command window after power-on, command
+// mode register reads and writes, conversions every update period with the
+// status bits set as the datasheet describes.
+class SimZSC31014 {
+public:
+    SimZSC31014(char address7bit, uint32_t updatePeriodUs = 500) :
+        _address(address7bit),
+        _updatePeriodNs((uint64_t)updatePeriodUs * 1000),
+        _responseDelayNs(100000),
+        _silentNs(0),
+        _powered(false),
+        _commandMode(false),
+        _diagnostic(false),
+        _bridge(0x2000),
+        _noise(4),
+        _seed(12345)
+    {
+        memset(registers, 0, sizeof(registers));
+    }
+
+    uint16_t registers[0x20]; // EEPROM words
+
+    void setPower(bool on) {
+        if (on && !_powered) {
+            _powerOnNs = SimClock::nowNs();
+            _conversionStartNs = _powerOnNs + (uint64_t)ZSC31014SIM_COMMAND_WINDOW_US * 1000;
+            _lastReadConversion = -1;
+            _commandMode = false;
+            _responseReadyNs = 0;
+        }
+        _powered = on;
+    }
+
+    void setBridge(uint16_t value, uint16_t noise) {
+        _bridge = value;
+        _noise = noise;
+    }
+
+    void setDiagnostic(bool fault) {
+        _diagnostic = fault;
+    }
+
+    // Command to response available in command mode
+    void setResponseDelayUs(uint32_t us) {
+        _responseDelayNs = (uint64_t)us * 1000;
+    }
+
+    // Power-on to first acknowledge, a chip still coming out of reset
+    void setSilentUs(uint32_t us) {
+        _silentNs = (uint64_t)us * 1000;
+    }
+
+    char getAddress() {
+        return _address;
+    }
+
+    bool isCommandMode() {
+        return _commandMode;
+    }
+
+    // false: not acknowledged
+    bool write(const uint8_t *data, int length) {
+        if (!this->isAnswering() || length < 1) {
+            return false;
+        }
+
+        uint64_t now = SimClock::nowNs();
+        uint8_t command = data[0];
+        uint16_t value = length >= 3 ? (data[1] << 8) | data[2] : 0;
+
+        if (command == 0xA0) {
+            if (now - _powerOnNs < (uint64_t)ZSC31014SIM_COMMAND_WINDOW_US * 1000) {
+                _commandMode = true;
+            }
+        } else if (command == 0x80) {
+            _commandMode = false;
+            _conversionStartNs = now;
+            _lastReadConversion = -1;
+        } else if (_commandMode && command < 0x20) {
+            _response = registers[command];
+            _responseReadyNs = now + _responseDelayNs;
+        } else if (_commandMode && command >= 0x40 && command < 0x60) {
+            registers[command - 0x40] = value;
+        }
+
+        return true;
+    }
+
+    bool read(uint8_t *data, int length) {
+        if (!this->isAnswering()) {
+            return false;
+        }
+
+        uint64_t now = SimClock::nowNs();
+        uint16_t word;
+
+        if (_commandMode) {
+            // Not ready yet: the output register still holds zeros
+            bool ready = _responseReadyNs != 0 && now >= _responseReadyNs;
+            uint8_t response[3] = { 0x00, 0x00, 0x00 };
+            if (ready) {
+                response[0] = 0x5A;
+                response[1] = _response >> 8;
+                response[2] = _response & 0xFF;
+            }
+            for (int i = 0; i < length; i++) {
+                data[i] = i < 3 ? response[i] : 0x00;
+            }
+            return true;
+        }
+
+        if (now < _conversionStartNs + _updatePeriodNs) {
+            word = 0x8000; // stale, no conversion yet
+        } else {
+            int64_t conversion = (now - _conversionStartNs) / _updatePeriodNs;
+            uint16_t status = (conversion == _lastReadConversion) ? 0b10 : 0b00;
+            _lastReadConversion = conversion;
+
+            if (_diagnostic) {
+                word = 0xFFFF;
+            } else {
+                // Same conversion gives the same value
+                uint32_t x = _seed ^ (uint32_t)(conversion * 2654435761u);
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+                int data = _bridge + (_noise ? (int)(x % (2 * _noise + 1)) - _noise : 0);
+                data = data < 0 ? 0 : (data > 0x3FFF ? 0x3FFF : data);
+                word = (status << 14) | data;
+            }
+        }
+
+        uint8_t bytes[4] = { (uint8_t)(word >> 8), (uint8_t)(word & 0xFF), 0x00, 0x00 };
+        for (int i = 0; i < length; i++) {
+            data[i] = i < 4 ? bytes[i] : 0x00;
+        }
+
+        return true;
+    }
+
+private:
+    char _address;
+    uint64_t _updatePeriodNs;
+    uint64_t _responseDelayNs;
+    uint64_t _silentNs;
+    bool _powered;
+    bool _commandMode;
+    bool _diagnostic;
+    uint16_t _bridge;
+    uint16_t _noise;
+    uint32_t _seed;
+
+    uint64_t _powerOnNs;
+    uint64_t _conversionStartNs;
+    int64_t _lastReadConversion;
+
+    uint16_t _response;
+    uint64_t _responseReadyNs;
+
+    bool isAnswering() {
+        return _powered && SimClock::nowNs() - _powerOnNs >= _silentNs;
+    }
+};
+
+// I2C master with the mbed interface. Every transfer advances SimClock by its
+// time on the wire at the configured clock: start or repeated start, address
+// and data bytes with their acknowledge bits, stop and the bus free time
+// before the next start.
+class SimI2C {
+public:
+    SimI2C() :
+        _count(0),
+        _hz(100000),
+        _maxHz(1000000),
+        _busyNs(0),
+        _transactions(0),
+        _errors(0)
+    {
+    }
+
+    void attach(SimZSC31014 &device) {
+        if (_count < ZSC31014SIM_MAX_DEVICES) {
+            _devices[_count++] = &device;
+        }
+    }
+
+    void frequency(int hz) {
+        _hz = hz;
+    }
+
+    int getFrequency() {
+        return _hz;
+    }
+
+    // Fastest clock the simulated wiring carries; anything above corrupts data
+    void setMaxFrequency(int hz) {
+        _maxHz = hz;
+    }
+
+    int read(int address, char *data, int length, bool repeated = false) {
+        SimZSC31014 *device = this->transaction(address, length, repeated);
+
+        if (device == NULL || !device->read((uint8_t *)data, length)) {
+            _errors++;
+            return -1;
+        }
+
+        if (_hz > _maxHz) {
+            data[0] ^= 0x10; // rise time too slow: a data bit is sampled wrong, the status looks fine
+        }
+
+        return 0;
+    }
+
+    int write(int address, const char *data, int length, bool repeated = false) {
+        SimZSC31014 *device = this->transaction(address, length, repeated);
+
+        if (device == NULL || _hz > _maxHz || !device->write((const uint8_t *)data, length)) {
+            _errors++;
+            return -1;
+        }
+
+        return 0;
+    }
+
+    // Time one transaction of length data bytes occupies the bus
+    uint64_t transactionNs(int length, bool repeated) {
+        uint64_t bitNs = 1000000000ull / _hz;
+        int bits = 1 + 9 * (1 + length) + (repeated ? 0 : 1);
+
+        return bits * bitNs + (repeated ? 0 : this->busFreeNs());
+    }
+
+    uint64_t getBusyNs() { return _busyNs; }
+    uint32_t getTransactions() { return _transactions; }
+    uint32_t getErrors() { return _errors; }
+
+    void resetStats() {
+        _busyNs = 0;
+        _transactions = 0;
+        _errors = 0;
+    }
+
+private:
+    SimZSC31014 *_devices[ZSC31014SIM_MAX_DEVICES];
+    int _count;
+    int _hz;
+    int _maxHz;
+    uint64_t _busyNs;
+    uint32_t _transactions;
+    uint32_t _errors;
+
+    // tBUF from the I2C specification
+    uint64_t busFreeNs() {
+        if (_hz > 400000) {
+            return 500;
+        }
+        return _hz > 100000 ? 1300 : 4700;
+    }
+
+    SimZSC31014 *transaction(int address, int length, bool repeated) {
+        uint64_t ns = this->transactionNs(length, repeated);
+
+        SimClock::advanceNs(ns);
+        _busyNs += ns;
+        _transactions++;
+
+        for (int i = 0; i < _count; i++) {
+            if ((_devices[i]->getAddress() << 1) == (address & 0xFE)) {
+                return _devices[i];
+            }
+        }
+
+        return NULL;
+    }
+};
+
+// Power pin wired to the simulated chip's supply
+class SimPower {
+public:
+    SimPower(SimZSC31014 &device) :
+        _device(&device)
+    {
+    }
+
+    void write(int value) {
+        _device->setPower(value != 0);
+    }
+
+private:
+    SimZSC31014 *_device;
+};
+
+typedef ZSC31014Core<SimI2C, SimDelay, SimPower> ZSC31014Simulated;
+
+} // namespace metromotive
+
+#endif //ZSC31014SIM_H
@@ -0,0 +1,172 @@
+// Copyright 2023 prisma
+
+#include "LinuxI2C.h"
+#include <fcntl.h>
+#include <linux/i2c-dev.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace metromotive {
+
+LinuxI2C::LinuxI2C(const char *device) :
+    _fd(-1),
+    _transport(NULL),
+    _context(NULL),
+    _transfers(0),
+    _pendingAddress(-1),
+    _pendingLength(0)
+{
+    if (device != NULL) {
+        _fd = open(device, O_RDWR);
+        if (_fd < 0) {
+            perror(device);
+        }
+    }
+}
+
+LinuxI2C::~LinuxI2C() {
+    this->flushPending();
+
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+bool LinuxI2C::isOpen() {
+    return _fd >= 0 || _transport != NULL;
+}
+
+void LinuxI2C::setTransport(Transport transport, void *context) {
+    _transport = transport;
+    _context = context;
+}
+
+void LinuxI2C::frequency(int) {
+}
+
+int LinuxI2C::transfer(struct i2c_msg *messages, int count) {
+    _transfers++;
+
+    if (_transport != NULL) {
+        return _transport(_context, messages, count) == count ? 0 : -1;
+    }
+
+    struct i2c_rdwr_ioctl_data request;
+    request.msgs = messages;
+    request.nmsgs = count;
+
+    return ioctl(_fd, I2C_RDWR, &request) == count ? 0 : -1;
+}
+
+int LinuxI2C::flushPending() {
+    if (_pendingAddress < 0) {
+        return 0;
+    }
+
+    struct i2c_msg message;
+    message.addr = _pendingAddress >> 1;
+    message.flags = 0;
+    message.len = _pendingLength;
+    message.buf = (uint8_t *)_pending;
+
+    _pendingAddress = -1;
+
+    return this->transfer(&message, 1);
+}
+
+int LinuxI2C::read(int address, char *data, int length, bool) {
+    if (_pendingAddress == address) {
+        _pendingAddress = -1;
+        return this->writeRead(address, _pending, _pendingLength, data, length);
+    }
+
+    if (this->flushPending() != 0) {
+        return -1;
+    }
+
+    struct i2c_msg message;
+    message.addr = address >> 1;
+    message.flags = I2C_M_RD;
+    message.len = length;
+    message.buf = (uint8_t *)data;
+
+    return this->transfer(&message, 1);
+}
+
+int LinuxI2C::write(int address, const char *data, int length, bool repeated) {
+    if (this->flushPending() != 0) {
+        return -1;
+    }
+
+    // Sent with the next read, as one combined transaction
+    if (repeated && length <= LINUXI2C_PENDING_MAX) {
+        memcpy(_pending, data, length);
+        _pendingLength = length;
+        _pendingAddress = address;
+        return 0;
+    }
+
+    struct i2c_msg message;
+    message.addr = address >> 1;
+    message.flags = 0;
+    message.len = length;
+    message.buf = (uint8_t *)data;
+
+    return this->transfer(&message, 1);
+}
+
+int LinuxI2C::writeRead(int address, const char *writeData, int writeLength, char *readData, int readLength) {
+    if (this->flushPending() != 0) {
+        return -1;
+    }
+
+    struct i2c_msg messages[2];
+
+    messages[0].addr = address >> 1;
+    messages[0].flags = 0;
+    messages[0].len = writeLength;
+    messages[0].buf = (uint8_t *)writeData;
+
+    messages[1].addr = address >> 1;
+    messages[1].flags = I2C_M_RD;
+    messages[1].len = readLength;
+    messages[1].buf = (uint8_t *)readData;
+
+    return this->transfer(messages, 2);
+}
+
+int LinuxI2C::readMany(const char *addresses, char *data, int length, int count) {
+    struct i2c_msg messages[I2C_RDWR_IOCTL_MAX_MSGS];
+
+    if (this->flushPending() != 0) {
+        return -1;
+    }
+
+    for (int first = 0; first < count; first += I2C_RDWR_IOCTL_MAX_MSGS) {
+        int batch = count - first;
+        if (batch > I2C_RDWR_IOCTL_MAX_MSGS) {
+            batch = I2C_RDWR_IOCTL_MAX_MSGS;
+        }
+
+        for (int i = 0; i < batch; i++) {
+            messages[i].addr = (uint8_t)addresses[first + i] >> 1;
+            messages[i].flags = I2C_M_RD;
+            messages[i].len = length;
+            messages[i].buf = (uint8_t *)data + (first + i) * length;
+        }
+
+        if (this->transfer(messages, batch) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+uint32_t LinuxI2C::getTransfers() {
+    return _transfers;
+}
+
+} // namespace metromotive
@@ -0,0 +1,69 @@
+// Copyright 2023 prisma
+
+#ifndef LINUXI2C_H
+#define LINUXI2C_H
+
+#include <linux/i2c.h>
+#include <stdint.h>
+
+// Longest write held back for a following repeated-start read
+#define LINUXI2C_PENDING_MAX 8
+
+namespace metromotive {
+
+// /dev/i2c-N backend with the mbed I2C interface (8-bit addresses, 0 on success).
+//
+// Every call is one I2C_RDWR ioctl. A write with repeated = true is held back
+// and sent together with the next read from the same address, so a command
+// write and its response read cost a single syscall; readMany() reads several
+// devices in one.
+//
+// setTransport() replaces the ioctl with an in-process function, e.g. a fake
+// bus for tests and benchmarks.
+class LinuxI2C {
+public:
+    typedef int (*Transport)(void *context, struct i2c_msg *messages, int count);
+
+    LinuxI2C(const char *device);
+    ~LinuxI2C();
+
+    bool isOpen();
+    void setTransport(Transport transport, void *context);
+
+    void frequency(int hz); // fixed by the adapter driver / device tree
+
+    int read(int address, char *data, int length, bool repeated = false);
+    int write(int address, const char *data, int length, bool repeated = false);
+    int writeRead(int address, const char *writeData, int writeLength, char *readData, int readLength);
+
+    // count devices, length bytes each, data laid out device after device
+    int readMany(const char *addresses, char *data, int length, int count);
+
+    uint32_t getTransfers(); // ioctl (or transport) calls issued
+
+private:
+    int _fd;
+    Transport _transport;
+    void *_context;
+    uint32_t _transfers;
+
+    int _pendingAddress;
+    char _pending[LINUXI2C_PENDING_MAX];
+    int _pendingLength;
+
+    int transfer(struct i2c_msg *messages, int count);
+    int flushPending();
+
+    // _fd is closed by the destructor
+    LinuxI2C(const LinuxI2C &);
+    LinuxI2C &operator=(const LinuxI2C &);
+};
+
+// The clock comes from the adapter driver or device tree, not from i2c-dev
+inline bool setBusFrequency(LinuxI2C &, int) {
+    return false;
+}
+
+} // namespace metromotive
+
+#endif //LINUXI2C_H
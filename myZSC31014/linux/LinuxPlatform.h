@@ -0,0 +1,71 @@
+// Copyright 2023 prisma
+
+#ifndef LINUXPLATFORM_H
+#define LINUXPLATFORM_H
+
+// The small part of the mbed API the ZSC31014 driver uses, for Linux builds
+
+#include "LinuxI2C.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+typedef metromotive::LinuxI2C I2C;
+typedef int PinName;
+
+#define NC (-1)
+
+// Power pin as a sysfs GPIO (already exported); NC only remembers the value
+class DigitalOut {
+public:
+    DigitalOut(PinName gpio = NC, int value = 0) :
+        _gpio(gpio)
+    {
+        this->write(value);
+    }
+
+    void write(int value) {
+        _value = value;
+
+        if (_gpio == NC) {
+            return;
+        }
+
+        char path[48];
+        snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/value", _gpio);
+
+        FILE *file = fopen(path, "w");
+        if (file != NULL) {
+            fputs(value ? "1" : "0", file);
+            fclose(file);
+        }
+    }
+
+    int read() {
+        return _value;
+    }
+
+    DigitalOut &operator=(int value) {
+        this->write(value);
+        return *this;
+    }
+
+    operator int() {
+        return _value;
+    }
+
+private:
+    PinName _gpio;
+    int _value;
+};
+
+inline void wait_us(int us) {
+    struct timespec delay = { us / 1000000, (long)(us % 1000000) * 1000 };
+    nanosleep(&delay, NULL);
+}
+
+inline void thread_sleep_for(uint32_t ms) {
+    wait_us(ms * 1000);
+}
+
+#endif //LINUXPLATFORM_H
@@ -0,0 +1,103 @@
+// Copyright 2023 prisma
+//
+// Bus time per sample on the simulated bus at 100 kHz, 400 kHz and 1 MHz:
+// one sensor, four sensors read with a stop after each and chained with
+// repeated starts, and command-mode register reads split (write, 100 us,
+// read) and combined. Also runs negotiateBusSpeed() with 1 MHz allowed
+// against wiring that only carries 400 kHz, and with the default limit
+// against wiring that only carries 100 kHz, to show the fallback.
+//
+// Build on the host:
+//   g++ -O2 -I../myZSC31014 bench_busspeed.cpp ../myZSC31014/HealthMonitor.cpp ../myZSC31014/ZLog.cpp -o bench_busspeed
+
+#include "ZSC31014Sim.h"
+#include <stdio.h>
+
+using namespace metromotive;
+
+static const int cells = 4;
+static const int samples = 1000;
+
+int main() {
+    SimI2C bus;
+    SimZSC31014 *chips[cells];
+    ZSC31014Simulated *sensors[cells];
+
+    for (int i = 0; i < cells; i++) {
+        chips[i] = new SimZSC31014(0x28 + i);
+        chips[i]->registers[0x00] = 0x1234;     // Cust_ID0
+        chips[i]->registers[0x01] = 0x0002 | i; // ZMDI_Config1
+        bus.attach(*chips[i]);
+        sensors[i] = new ZSC31014Simulated(bus, 0x28 + i, SimPower(*chips[i]));
+        sensors[i]->powerUp();
+    }
+    SimDelay::ms(10); // past the command window, converting
+
+    printf("%8s %12s %14s %14s %14s %14s\n", "clock", "1 sensor", "4 with stops", "4 chained",
+           "reg split", "reg combined");
+
+    for (unsigned int s = 0; s < sizeof(zsc31014BusSpeeds) / sizeof(zsc31014BusSpeeds[0]); s++) {
+        int hz = zsc31014BusSpeeds[sizeof(zsc31014BusSpeeds) / sizeof(zsc31014BusSpeeds[0]) - 1 - s];
+        bus.frequency(hz);
+
+        bus.resetStats();
+        for (int n = 0; n < samples; n++) {
+            sensors[0]->read_raw();
+        }
+        double singleUs = bus.getBusyNs() / 1000.0 / samples;
+
+        bus.resetStats();
+        for (int n = 0; n < samples; n++) {
+            for (int i = 0; i < cells; i++) {
+                sensors[i]->read_raw();
+            }
+        }
+        double stopsUs = bus.getBusyNs() / 1000.0 / samples;
+
+        bus.resetStats();
+        for (int n = 0; n < samples; n++) {
+            for (int i = 0; i < cells; i++) {
+                sensors[i]->read_raw_word(i + 1 < cells);
+            }
+        }
+        double chainedUs = bus.getBusyNs() / 1000.0 / samples;
+
+        // Register reads: time until the value is available, not only bus time
+        ZSC31014Simulated &sensor = *sensors[0];
+        double registerUs[2];
+
+        for (int combined = 0; combined < 2; combined++) {
+            // A chip answering without the 100 us gap; the default model needs it
+            chips[0]->setResponseDelayUs(combined ? 0 : 100);
+            sensor.startCommandMode();
+            sensor.setCombinedReads(combined && sensor.probeCombinedReads());
+
+            uint64_t start = SimClock::nowNs();
+            for (int n = 0; n < samples; n++) {
+                sensor.readRegister(0x00);
+            }
+            registerUs[combined] = (SimClock::nowNs() - start) / 1000.0 / samples;
+
+            sensor.startNormalOperationMode();
+        }
+        SimDelay::ms(1);
+
+        printf("%6d k %9.1f us %11.1f us %11.1f us %11.1f us %11.1f us\n", hz / 1000, singleUs,
+               stopsUs, chainedUs, registerUs[0], registerUs[1]);
+    }
+
+    // The default model answers command mode only after 100 us: the probe must refuse
+    sensors[0]->startCommandMode();
+    chips[0]->setResponseDelayUs(100);
+    printf("combined reads with a 100 us response delay: %s\n",
+           sensors[0]->probeCombinedReads() ? "on" : "off");
+    sensors[0]->startNormalOperationMode();
+    SimDelay::ms(1);
+
+    bus.setMaxFrequency(400000);
+    printf("negotiated on 400 kHz wiring, 1 MHz allowed: %d Hz\n", sensors[1]->negotiateBusSpeed(1000000));
+    bus.setMaxFrequency(100000);
+    printf("negotiated on 100 kHz wiring: %d Hz\n", sensors[1]->negotiateBusSpeed());
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+// Copyright 2023 prisma
+//
+// Host benchmark of the block calibration kernel against the per-sample path
+// of ZSC31014::read_corrected() and against calibrateBlockScalar().
+//
+// correct_block() folds offset - bias into one constant ahead of time, so its
+// output can differ from read_corrected() in the last bit; the check below
+// therefore compares against calibrateBlockScalar(), which folds the same way.
+//
+// Build on the host:
+//   g++ -O2 -march=native -I../myZSC31014 bench_calibration.cpp ../myZSC31014/CalibrationKernel.cpp -o bench_calibration
+
+#include "CalibrationKernel.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace metromotive;
+
+// Mirrors ZSC31014::read_corrected(): gain * raw + offset - bias per sample.
+// Plain memory, so the compiler reloads the calibration only where the output
+// stores may alias it, as it would in the driver.
+struct Calibration {
+    float calibpoly[2];
+    float bias;
+};
+
+static Calibration calibration = { { 0.75f, 12.5f }, 3.25f };
+
+static void perSample(const uint16_t *words, int n, float *out, uint8_t *status) {
+    for (int i = 0; i < n; i++) {
+        out[i] = calibration.calibpoly[0] * (words[i] & 0x3FFF) + calibration.calibpoly[1] - calibration.bias;
+        status[i] = words[i] >> 14;
+    }
+}
+
+static void scalar(const uint16_t *words, int n, float *out, uint8_t *status) {
+    calibrateBlockScalar(words, n, calibration.calibpoly[0], calibration.calibpoly[1] - calibration.bias, out, status);
+}
+
+static void block(const uint16_t *words, int n, float *out, uint8_t *status) {
+    calibrateBlock(words, n, calibration.calibpoly[0], calibration.calibpoly[1] - calibration.bias, out, status);
+}
+
+static double samplesPerSecond(void (*convert)(const uint16_t *, int, float *, uint8_t *),
+                               const uint16_t *words, int n, float *out, uint8_t *status) {
+    const long total = 1L << 26;
+    long repeats = total / n;
+
+    auto start = std::chrono::steady_clock::now();
+    for (long r = 0; r < repeats; r++) {
+        convert(words, n, out, status);
+        __asm__ __volatile__("" : : "r"(out) : "memory");
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    return repeats * n / std::chrono::duration<double>(stop - start).count();
+}
+
+int main() {
+    static const int sizes[] = { 4, 16, 64, 256, 1024, 4096 };
+    static uint16_t words[4096];
+    static float out[4096];
+    static float check[4096];
+    static uint8_t status[4096];
+    static uint8_t checkStatus[4096];
+
+    for (int i = 0; i < 4096; i++) {
+        words[i] = rand() & 0xFFFF;
+    }
+
+    calibrateBlock(words, 4093, 0.75f, 9.25f, out, status);
+    calibrateBlockScalar(words, 4093, 0.75f, 9.25f, check, checkStatus);
+    for (int i = 0; i < 4093; i++) {
+        if (out[i] != check[i] || status[i] != checkStatus[i]) {
+            printf("Mismatch at %d\n", i);
+            return 1;
+        }
+    }
+
+    printf("block    Msamples/s: per-sample  scalar kernel  block kernel   speedup vs per-sample / scalar\n");
+    for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        double single = samplesPerSecond(perSample, words, sizes[i], out, status);
+        double reference = samplesPerSecond(scalar, words, sizes[i], out, status);
+        double batched = samplesPerSecond(block, words, sizes[i], out, status);
+        printf("%-7d              %-10.1f  %-13.1f  %-13.1f  %.2fx / %.2fx\n", sizes[i], single / 1e6, reference / 1e6,
+               batched / 1e6, batched / single, batched / reference);
+    }
+
+    return 0;
+}
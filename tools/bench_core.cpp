@@ -0,0 +1,83 @@
+// Copyright 2023 prisma
+//
+// Host comparison of read_raw() through the ZSC31014 class and through the
+// ZSC31014Core template on the same LinuxI2C, with the ioctl replaced by an
+// in-process transport so only the driver layers are timed. The simulator
+// combination is run as well.
+//
+// Code size of the two read paths (readClass / readCore):
+//   nm -S --size-sort -C bench_core | grep read
+//
+// Build on the host:
+//   g++ -O2 -I../myZSC31014 -I../myZSC31014/linux bench_core.cpp ../myZSC31014/ZSC31014.cpp ../myZSC31014/HealthMonitor.cpp ../myZSC31014/CalibrationKernel.cpp ../myZSC31014/ZLog.cpp ../myZSC31014/linux/LinuxI2C.cpp -o bench_core
+
+#include "ZSC31014.h"
+#include "ZSC31014Policies.h"
+#include "ZSC31014Sim.h"
+#include <chrono>
+#include <stdio.h>
+
+using namespace metromotive;
+
+static const int reads = 10000000;
+
+static int nullTransport(void *, struct i2c_msg *messages, int count) {
+    for (int i = 0; i < count; i++) {
+        if (messages[i].flags & I2C_M_RD) {
+            messages[i].buf[0] = 0x12;
+            messages[i].buf[1] = 0x34;
+        }
+    }
+    return count;
+}
+
+__attribute__((noinline)) uint16_t readClass(ZSC31014 &sensor) {
+    return sensor.read_raw();
+}
+
+__attribute__((noinline)) uint16_t readCore(ZSC31014Linux &sensor) {
+    return sensor.read_raw();
+}
+
+__attribute__((noinline)) uint16_t readSimulated(ZSC31014Simulated &sensor) {
+    return sensor.read_raw();
+}
+
+template <class Sensor>
+static double timeReads(Sensor &sensor, uint16_t (*read)(Sensor &)) {
+    uint32_t sum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < reads; i++) {
+        sum += read(sensor);
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    __asm__ __volatile__("" : : "r"(sum) : "memory");
+
+    return std::chrono::duration<double, std::nano>(stop - start).count() / reads;
+}
+
+int main() {
+    LinuxI2C i2c(NULL);
+    i2c.setTransport(nullTransport, NULL);
+
+    ZSC31014 sensorClass(i2c, 0x28, DigitalOut(NC, 1));
+    ZSC31014Linux sensorCore(i2c, 0x28, DigitalOut(NC, 1));
+
+    SimI2C simI2C;
+    SimZSC31014 chip(0x28);
+    simI2C.attach(chip);
+    ZSC31014Simulated sensorSim(simI2C, 0x28, SimPower(chip));
+    sensorSim.powerUp();
+
+    double classNs = timeReads(sensorClass, readClass);
+    double coreNs = timeReads(sensorCore, readCore);
+    double simNs = timeReads(sensorSim, readSimulated);
+
+    printf("read_raw() ZSC31014           %6.2f ns\n", classNs);
+    printf("read_raw() ZSC31014Linux      %6.2f ns\n", coreNs);
+    printf("read_raw() ZSC31014Simulated  %6.2f ns\n", simNs);
+
+    return 0;
+}
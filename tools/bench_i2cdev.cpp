@@ -0,0 +1,169 @@
+// Copyright 2023 prisma
+//
+// Host benchmark of the Linux i2c-dev backend: I2C_RDWR calls and time per
+// sample for one read per sensor against one batched read for all sensors, and
+// for command-mode register reads with and without the repeated-start
+// combined transfer.
+//
+// Without arguments the sensors are modelled in-process behind
+// LinuxI2C::setTransport() (the kernel's i2c-stub only implements SMBus, not
+// I2C_RDWR). With a device and 7-bit addresses it runs against real hardware:
+//   bench_i2cdev /dev/i2c-1 0x28 0x29 0x2a 0x2b
+//
+// Build on the host:
+//   g++ -O2 -I../myZSC31014 -I../myZSC31014/linux bench_i2cdev.cpp ../myZSC31014/ZSC31014.cpp ../myZSC31014/HealthMonitor.cpp ../myZSC31014/CalibrationKernel.cpp ../myZSC31014/ZLog.cpp ../myZSC31014/linux/LinuxI2C.cpp -o bench_i2cdev
+
+#include "ZSC31014.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace metromotive;
+
+static const int maxSensors = 16;
+static const int samples = 10000;
+static const int registerReads = 1000;
+
+// ZSC31014 as seen on the bus: 0xA0 enters command mode, a register read
+// command is answered by 0x5A and the word, a plain read returns a data word.
+struct FakeSensor {
+    uint16_t address; // 7-bit
+    bool commandMode;
+    uint8_t lastCommand;
+    uint16_t counter;
+};
+
+struct FakeBus {
+    FakeSensor sensors[maxSensors];
+    int count;
+    uint32_t messages;
+};
+
+static int fakeTransport(void *context, struct i2c_msg *messages, int count) {
+    FakeBus *bus = (FakeBus *)context;
+
+    for (int i = 0; i < count; i++) {
+        struct i2c_msg &message = messages[i];
+        FakeSensor *sensor = NULL;
+
+        for (int s = 0; s < bus->count; s++) {
+            if (bus->sensors[s].address == message.addr) {
+                sensor = &bus->sensors[s];
+            }
+        }
+        if (sensor == NULL) {
+            return -1; // NACK
+        }
+        bus->messages++;
+
+        if (!(message.flags & I2C_M_RD)) {
+            uint8_t command = message.buf[0];
+            if (command == 0xA0) {
+                sensor->commandMode = true;
+            } else if (command == 0x80) {
+                sensor->commandMode = false;
+            }
+            sensor->lastCommand = command;
+            continue;
+        }
+
+        if (sensor->commandMode && message.len == 3) {
+            message.buf[0] = 0x5A;
+            message.buf[1] = sensor->lastCommand;
+            message.buf[2] = sensor->address;
+        } else {
+            sensor->counter = (sensor->counter + 1) & 0x3FFF;
+            message.buf[0] = sensor->counter >> 8;
+            message.buf[1] = sensor->counter & 0xFF;
+        }
+    }
+
+    return count;
+}
+
+static double elapsedUs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+    const char *device = argc > 1 ? argv[1] : NULL;
+    int count = argc > 2 ? argc - 2 : 4;
+    if (count > maxSensors) {
+        count = maxSensors;
+    }
+
+    static FakeBus fake;
+    LinuxI2C i2c(device);
+
+    if (device == NULL) {
+        fake.count = count;
+        for (int i = 0; i < count; i++) {
+            fake.sensors[i].address = 0x28 + i;
+        }
+        i2c.setTransport(fakeTransport, &fake);
+    } else if (!i2c.isOpen()) {
+        return 1;
+    }
+
+    ZSC31014 *sensors[maxSensors];
+    for (int i = 0; i < count; i++) {
+        char address = device == NULL ? 0x28 + i : (char)strtol(argv[2 + i], NULL, 0);
+        sensors[i] = new ZSC31014(i2c, address, DigitalOut(NC, 1));
+    }
+
+    uint16_t words[maxSensors];
+
+    uint32_t transfers = i2c.getTransfers();
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < samples; n++) {
+        for (int i = 0; i < count; i++) {
+            words[i] = sensors[i]->read_raw_word();
+        }
+    }
+    double singleUs = elapsedUs(start) / samples;
+    double singleCalls = (double)(i2c.getTransfers() - transfers) / samples;
+
+    transfers = i2c.getTransfers();
+    start = std::chrono::steady_clock::now();
+    for (int n = 0; n < samples; n++) {
+        if (ZSC31014::read_raw_word_batch(sensors, count, words) != 0) {
+            printf("batch read failed\n");
+            return 1;
+        }
+    }
+    double batchUs = elapsedUs(start) / samples;
+    double batchCalls = (double)(i2c.getTransfers() - transfers) / samples;
+
+    printf("%d sensors, per sample of all sensors:\n", count);
+    printf("  one read each  %5.2f ioctls %8.2f us\n", singleCalls, singleUs);
+    printf("  batched read   %5.2f ioctls %8.2f us\n", batchCalls, batchUs);
+
+    // Command mode needs a power cycle; with real hardware that is only possible
+    // when the power pins are wired, so the register comparison stays on the model.
+    if (device != NULL) {
+        return 0;
+    }
+
+    ZSC31014 &sensor = *sensors[0];
+    sensor.startCommandMode();
+
+    for (int combined = 0; combined < 2; combined++) {
+        sensor.setCombinedReads(combined);
+
+        transfers = i2c.getTransfers();
+        start = std::chrono::steady_clock::now();
+        uint16_t value = 0;
+        for (int n = 0; n < registerReads; n++) {
+            value = sensor.getCustomerID0();
+        }
+        double us = elapsedUs(start) / registerReads;
+        double calls = (double)(i2c.getTransfers() - transfers) / registerReads;
+
+        printf("register read %-9s %5.2f ioctls %8.2f us (0x%04x)\n",
+               combined ? "combined" : "split", calls, us, value);
+    }
+
+    sensor.startNormalOperationMode();
+
+    return 0;
+}
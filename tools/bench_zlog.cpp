@@ -0,0 +1,61 @@
+// Copyright 2023 prisma
+//
+// Host benchmark of a tokenized ZLOG call against formatting the same message
+// with snprintf. Writes the drained log records to the file given as argument
+// so the output can be checked with zlog_decode.py.
+//
+// Build on the host:
+//   g++ -O2 -I../myZSC31014 bench_zlog.cpp ../myZSC31014/ZLog.cpp -o bench_zlog
+
+#include "ZLog.h"
+#include <chrono>
+#include <stdio.h>
+
+using namespace metromotive;
+
+static const int calls = 1000000;
+
+int main(int argc, char **argv) {
+    static char text[64];
+    static uint8_t drain[ZLOG_BUFFER_SIZE];
+    volatile int value = 1234;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; i++) {
+        snprintf(text, sizeof(text), "Read:  %d g\n", value + i);
+        __asm__ __volatile__("" : : "r"(text) : "memory");
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; i++) {
+        ZLOG_INFO("Read:  %d g", value + i);
+        if (zlog::read(drain, sizeof(drain)) == 0) {
+            return 1;
+        }
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    double formatted = std::chrono::duration<double, std::nano>(middle - start).count() / calls;
+    double tokenized = std::chrono::duration<double, std::nano>(stop - middle).count() / calls;
+
+    printf("snprintf %.1f ns/call, ZLOG %.1f ns/call (including drain)\n", formatted, tokenized);
+
+    if (argc > 1) {
+        FILE *capture = fopen(argv[1], "wb");
+        if (capture == NULL) {
+            return 1;
+        }
+
+        ZLOG_ERROR("Invalid response byte from device. Maybe not in command mode? (bytes are %2x %2x %2x).",
+                   (uint8_t)0xA5, (uint8_t)0x12, (uint8_t)0x34);
+        ZLOG_INFO("Actual gain %f", 1.5f);
+        ZLOG_INFO("Read:  %d g", -42);
+        ZLOG_INFO("0x%02x: 0x%04x", 3, 0xBEEF);
+
+        int count = zlog::read(drain, sizeof(drain));
+        fprintf(capture, "plain text\n");
+        fwrite(drain, 1, count, capture);
+        fclose(capture);
+    }
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+// Copyright 2023 prisma
+//
+// Host check of LowPowerSampler on the simulator: every sample must be valid
+// and the bridge on-time must stay within one poll interval and one read of
+// startupUs + conversionUs. Run once with the chip at
+// the update rate the sampler was told, once with a slower chip, where
+// the sampler has to poll until the first fresh conversion, and once with a
+// chip that does not acknowledge for a while after power-on. A sensor that
+// is not on the bus at all must give no valid sample, each slot counted as a
+// failure after the full timeout. Exits non-zero on failure.
+//
+// Build on the host:
+//   g++ -O2 -I../myZSC31014 -I../myZSC31014/linux check_lowpower.cpp ../myZSC31014/HealthMonitor.cpp ../myZSC31014/CalibrationKernel.cpp ../myZSC31014/ZLog.cpp -o check_lowpower
+
+#include "LowPowerSampler.h"
+#include "ZSC31014Sim.h"
+#include <stdio.h>
+
+using namespace metromotive;
+
+typedef LowPowerSamplerT<ZSC31014Simulated, SimTimer, SimDelay> SimulatedSampler;
+
+static const int samples = 50;
+
+static bool check(const char *name, uint32_t chipUpdateUs, ZSC31014::UpdateRate updateRate,
+                  uint32_t silentUs = 0) {
+    SimI2C bus;
+    SimZSC31014 chip(0x28, chipUpdateUs);
+    chip.setSilentUs(silentUs);
+    bus.attach(chip);
+    ZSC31014Simulated sensor(bus, 0x28, SimPower(chip));
+
+    SimulatedSampler sampler(sensor, 10.0f, ZSC31014::ClockSpeed::mhz4, updateRate);
+    SimulatedSampler::Sample sample;
+
+    // The first fresh conversion is due one chip update period after the
+    // command window, or once the chip answers, whichever is later
+    uint32_t expected = SimulatedSampler::startupUs(ZSC31014::ClockSpeed::mhz4) + chipUpdateUs;
+    expected = silentUs > expected ? silentUs : expected;
+    uint32_t limit = sampler.getExpectedOnTimeUs() > expected ? sampler.getExpectedOnTimeUs() : expected;
+    uint32_t readUs = (uint32_t)((bus.transactionNs(2, false) + 999) / 1000);
+    limit += LOWPOWER_POLL_US + readUs;
+    if (silentUs) {
+        limit += readUs; // the poll that was not acknowledged
+    }
+    bool ok = true;
+
+    for (int i = 0; i < samples; i++) {
+        if (!sampler.next(sample)) {
+            printf("%s: sample %d not valid (status %u)\n", name, i, sample.status);
+            ok = false;
+        } else if (sample.onTimeUs < expected || sample.onTimeUs > limit) {
+            printf("%s: sample %d on for %lu us, expected %lu-%lu us\n", name, i,
+                   (unsigned long)sample.onTimeUs, (unsigned long)expected, (unsigned long)limit);
+            ok = false;
+        }
+    }
+
+    SimulatedSampler::Stats stats = sampler.getStats();
+    printf("%-12s expected %5lu us, mean %7.1f us, max %5lu us, duty cycle %.4f, %lu failures: %s\n",
+           name, (unsigned long)sampler.getExpectedOnTimeUs(), stats.meanOnTimeUs,
+           (unsigned long)stats.maxOnTimeUs, stats.dutyCycle, (unsigned long)stats.failures,
+           ok ? "ok" : "FAIL");
+
+    return ok;
+}
+
+static bool checkUnattached(const char *name) {
+    SimI2C bus;
+    SimZSC31014 chip(0x28);
+    ZSC31014Simulated sensor(bus, 0x28, SimPower(chip)); // powered, never acknowledges
+
+    SimulatedSampler sampler(sensor, 10.0f);
+    SimulatedSampler::Sample sample;
+    bool ok = true;
+
+    for (int i = 0; i < samples; i++) {
+        if (sampler.next(sample) || sample.valid) {
+            printf("%s: sample %d valid without an answer (raw 0x%04x)\n", name, i, sample.raw);
+            ok = false;
+        } else if (sample.status == (uint8_t)ZSC31014::Status::valid) {
+            printf("%s: sample %d reported with valid status\n", name, i);
+            ok = false;
+        } else if (sample.onTimeUs < sampler.getTimeoutUs()) {
+            printf("%s: sample %d gave up after %lu us, timeout %lu us\n", name, i,
+                   (unsigned long)sample.onTimeUs, (unsigned long)sampler.getTimeoutUs());
+            ok = false;
+        }
+    }
+
+    SimulatedSampler::Stats stats = sampler.getStats();
+    if (stats.failures != (uint32_t)samples) {
+        printf("%s: %lu failures counted, expected %d\n", name, (unsigned long)stats.failures, samples);
+        ok = false;
+    }
+    printf("%-12s timeout  %5lu us, mean %7.1f us, max %5lu us, duty cycle %.4f, %lu failures: %s\n",
+           name, (unsigned long)sampler.getTimeoutUs(), stats.meanOnTimeUs,
+           (unsigned long)stats.maxOnTimeUs, stats.dutyCycle, (unsigned long)stats.failures,
+           ok ? "ok" : "FAIL");
+
+    return ok;
+}
+
+int main() {
+    bool ok = true;
+
+    ok &= check("as told", 500, ZSC31014::UpdateRate::fastest);
+    ok &= check("slower chip", 1500, ZSC31014::UpdateRate::fastest);
+    ok &= check("slow reset", 500, ZSC31014::UpdateRate::fastest, 5000);
+    ok &= checkUnattached("unattached");
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,63 @@
+// Copyright 2023 prisma
+//
+// Offline noise report over a recorded trace of raw samples (one value per line,
+// as printed by the characterization mode in main.cpp).
+//
+// Build on the host:
+//   g++ -O2 -I../myZSC31014 noise_report.cpp ../myZSC31014/NoiseAnalyzer.cpp -o noise_report
+// Usage:
+//   ./noise_report <sample period s> <target noise counts> [trace file]
+
+#include "NoiseAnalyzer.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace metromotive;
+
+static NoiseAnalyzer analyzer(1.0f);
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <sample period s> <target noise counts> [trace file]\n", argv[0]);
+        return 1;
+    }
+
+    float samplePeriod = atof(argv[1]);
+    float targetNoise = atof(argv[2]);
+    FILE *trace = stdin;
+
+    if (argc > 3) {
+        trace = fopen(argv[3], "r");
+        if (trace == NULL) {
+            fprintf(stderr, "Unable to open %s\n", argv[3]);
+            return 1;
+        }
+    }
+
+    analyzer.setSamplePeriod(samplePeriod);
+
+    char line[64];
+    while (fgets(line, sizeof(line), trace) != NULL) {
+        char *end;
+        long value = strtol(line, &end, 10);
+
+        // Skip anything that is not a bare sample (banners, reports)
+        if (end == line || (*end != '\n' && *end != '\r' && *end != '\0')) {
+            continue;
+        }
+
+        if (value < 0 || value > 0x3FFF) {
+            continue;
+        }
+
+        analyzer.addSample((uint16_t)value);
+    }
+
+    if (trace != stdin) {
+        fclose(trace);
+    }
+
+    analyzer.printReport(targetNoise);
+
+    return 0;
+}
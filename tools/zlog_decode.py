@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+# Copyright 2023 prisma
+#
+# Expands tokenized ZLOG records back into text.
+#
+# The token database is built from the ZLOG_* call sites found in the sources,
+# using the same FNV-1a hash as ZLog.h. Anything in the stream that is not a
+# valid frame (plain printf output) is passed through unchanged.
+#
+# Usage:
+#   zlog_decode.py [-s SOURCE_DIR ...] [capture file or serial device]
+#   e.g. zlog_decode.py -s . /dev/ttyACM0
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+FRAME_SYNC = 0xA5
+CALL_SITE = re.compile(r'ZLOG_(ERROR|WARN|INFO|DEBUG)\(\s*"((?:[^"\\]|\\.)*)"')
+SPECIFIER = re.compile(r'%([-+ #0]*\d*(?:\.\d+)?)(hh|h|ll|l|z|j|t)?([diouxXfFeEgGcs%])')
+ESCAPES = {'n': '\n', 't': '\t', 'r': '\r', '\\': '\\', '"': '"', "'": "'", '0': '\0'}
+
+
+def fnv1a(data):
+    h = 2166136261
+    for byte in data:
+        h = ((h ^ byte) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def unescape(literal):
+    return re.sub(r'\\(.)', lambda m: ESCAPES.get(m.group(1), m.group(1)), literal)
+
+
+def build_database(directories):
+    database = {}
+    for directory in directories:
+        for root, _, files in os.walk(directory):
+            for name in files:
+                if not name.endswith(('.cpp', '.h', '.hpp', '.c')):
+                    continue
+                with open(os.path.join(root, name), encoding='utf-8', errors='replace') as source:
+                    for match in CALL_SITE.finditer(source.read()):
+                        fmt = unescape(match.group(2))
+                        token = fnv1a(fmt.encode('utf-8'))
+                        database.setdefault(token, (match.group(1), fmt))
+    return database
+
+
+def read_varint(payload, position):
+    value = 0
+    shift = 0
+    while True:
+        byte = payload[position]
+        position += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, position
+
+
+def decode_arguments(payload):
+    arguments = []
+    position = 0
+    while position < len(payload):
+        tag = payload[position]
+        position += 1
+        if tag == 0:
+            value, position = read_varint(payload, position)
+            arguments.append((value >> 1) ^ -(value & 1))
+        elif tag == 1:
+            value, position = read_varint(payload, position)
+            arguments.append(value)
+        elif tag == 2:
+            arguments.append(struct.unpack_from('<f', payload, position)[0])
+            position += 4
+        elif tag == 3:
+            length = payload[position]
+            arguments.append(payload[position + 1:position + 1 + length].decode('utf-8', 'replace'))
+            position += 1 + length
+        else:
+            raise ValueError('unknown argument type %d' % tag)
+    return arguments
+
+
+def format_record(fmt, arguments):
+    # Python's % operator has no length modifiers
+    pyfmt = SPECIFIER.sub(lambda m: '%' + m.group(1) + m.group(3), fmt)
+    try:
+        return pyfmt % tuple(arguments)
+    except (TypeError, ValueError):
+        return '%s %r' % (fmt, arguments)
+
+
+def decode_stream(stream, database, out):
+    data = bytearray()
+    while True:
+        chunk = stream.read(1) if stream.isatty() else stream.read(4096)
+        if not chunk:
+            break
+        data += chunk
+
+        while data:
+            if data[0] != FRAME_SYNC:
+                out.write(chr(data.pop(0)))
+                continue
+            if len(data) < 2 or len(data) < data[1] + 3:
+                break
+
+            length = data[1]
+            payload = bytes(data[2:2 + length])
+            check = 0
+            for byte in payload:
+                check ^= byte
+
+            if length < 4 or check != data[2 + length]:
+                out.write(chr(data.pop(0)))
+                continue
+
+            del data[:length + 3]
+            token = struct.unpack_from('<I', payload)[0]
+            level, fmt = database.get(token, ('?', None))
+
+            try:
+                arguments = decode_arguments(payload[4:])
+            except (IndexError, ValueError, struct.error):
+                arguments = ['<truncated>']
+
+            if fmt is None:
+                out.write('[?] unknown token 0x%08x %r\n' % (token, arguments))
+            else:
+                out.write('[%s] %s\n' % (level[0], format_record(fmt, arguments)))
+        out.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Expand tokenized ZLOG output.')
+    parser.add_argument('-s', '--source', action='append',
+                        help='source directory to scan for ZLOG call sites (default: repository root)')
+    parser.add_argument('input', nargs='?', help='capture file or serial device (default: stdin)')
+    args = parser.parse_args()
+
+    directories = args.source or [os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')]
+    database = build_database(directories)
+
+    if args.input:
+        with open(args.input, 'rb', buffering=0) as stream:
+            decode_stream(stream, database, sys.stdout)
+    else:
+        decode_stream(sys.stdin.buffer, database, sys.stdout)
+
+
+if __name__ == '__main__':
+    main()